@@ -116,16 +116,13 @@ def _filter_and_sort_coverage_files(
     root: Path, extension: str, lookup_file_name: str
 ) -> List[Path]:
     # By default, the BinaryRTS listener and client dump coverage after test suite execution,
-    # which will be discarded here.
+    # which will be discarded here (shards of sharded test runs dump to `shard<N>_coverage{extension}`).
     return sorted(
         [
             file
             for file in root.glob(f"**/*{extension}")
-            if file.name
-            not in [
-                lookup_file_name,
-                f"coverage{extension}",
-            ]
+            if file.name != lookup_file_name
+            and not file.name.endswith(f"coverage{extension}")
         ],
         reverse=True,
     )
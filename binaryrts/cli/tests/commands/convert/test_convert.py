@@ -1,4 +1,5 @@
 import os.path
+import tempfile
 import unittest
 from pathlib import Path
 from typing import Optional
@@ -7,8 +8,11 @@ from typer.testing import CliRunner
 
 from binaryrts.commands.convert import (
     app,
+    _filter_and_sort_coverage_files,
+    _parse_coverage_files,
 )
 from binaryrts.parser.coverage import (
+    CoverageParser,
     FunctionLookupTable,
     TestFunctionTraces,
     TestFileTraces,
@@ -760,6 +764,65 @@ other_lib.dll ({JAVA_MODULE_DIR / "other_lib.dll"})
             test_file_traces,
         )
 
+    def test_convert_sharded_dumps(self):
+        # two shards of the same test binary dump to the same directory with `shard<N>_` prefixes
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            module_dir: Path = Path(tmp_dir) / "sample_module"
+            module_dir.mkdir()
+            for shard, test_case in [(0, "FooTestCase"), (1, "AlwaysTrue")]:
+                for file_name in [f"shard{shard}_1.log", f"shard{shard}_2.log", f"shard{shard}_coverage.log"]:
+                    (module_dir / file_name).write_text("")
+                (module_dir / "dump-lookup.log").open(mode="a+").write(
+                    f"shard{shard}_1;{GLOBAL_TEST_SETUP}___shard{shard}\n"
+                    f"shard{shard}_2;FooSuite.{test_case}___PASSED\n"
+                )
+
+            coverage_files = _filter_and_sort_coverage_files(
+                root=module_dir, extension=".log", lookup_file_name="dump-lookup.log"
+            )
+            self.assertEqual(
+                sorted(file.name for file in coverage_files),
+                ["shard0_1.log", "shard0_2.log", "shard1_1.log", "shard1_2.log"],
+            )
+
+            parser: CoverageParser = CoverageParser(
+                extension=".log", lookup_files=[module_dir / "dump-lookup.log"]
+            )
+            tests = {
+                (coverage.test_module, coverage.test_suite, coverage.test_case)
+                for coverage in map(parser.parse_coverage, coverage_files)
+            }
+            self.assertEqual(
+                {
+                    ("sample_module", GLOBAL_TEST_SETUP, "*"),
+                    ("sample_module", "FooSuite", "FooTestCase"),
+                    ("sample_module", "FooSuite", "AlwaysTrue"),
+                },
+                tests,
+            )
+
+    def test_convert_keeps_skipped_tests(self):
+        # excluded tests do not dump at all, hence dumps of skipped tests are from tests that skipped themselves
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            module_dir: Path = Path(tmp_dir) / "sample_module"
+            module_dir.mkdir()
+            for file_name in ["1.log", "2.log"]:
+                (module_dir / file_name).write_text("")
+            (module_dir / "dump-lookup.log").write_text(
+                "1;FooSuite.AlwaysTrue___PASSED\n" "2;FooSuite.FooTestCase___SKIPPED\n"
+            )
+
+            parser: CoverageParser = CoverageParser(
+                extension=".log", lookup_files=[module_dir / "dump-lookup.log"]
+            )
+            tests = {
+                (coverage.test_suite, coverage.test_case)
+                for coverage in _parse_coverage_files(
+                    coverage_files=[module_dir / "1.log", module_dir / "2.log"], parser=parser
+                )
+            }
+            self.assertEqual({("FooSuite", "AlwaysTrue"), ("FooSuite", "FooTestCase")}, tests)
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -115,6 +115,11 @@ options_init(client_id_t id, int argc, const char *argv[], covlib_options_t *ops
     ops->runtime_dump = false;
     ops->dump_bb_size = false;
     ops->syscalls = false;
+    ops->stats = false;
+    ops->trace_policy = COVLIB_TRACE_POLICY_ALL;
+    ops->sample_interval = 0;
+    ops->stream_path = NULL;
+    ops->dump_prefix = NULL;
 
     for (i = 1 /*skip client*/; i < argc; i++) {
         token = argv[i];
@@ -135,6 +140,31 @@ options_init(client_id_t id, int argc, const char *argv[], covlib_options_t *ops
             ops->dump_bb_size = true;
         else if (strcmp(token, "-syscalls") == 0) {
             ops->syscalls = true;
+        } else if (strcmp(token, "-stats") == 0) {
+            ops->stats = true;
+        } else if (strcmp(token, "-trace_policy") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -trace_policy value");
+            token = argv[++i];
+            if (strcmp(token, "all") == 0)
+                ops->trace_policy = COVLIB_TRACE_POLICY_ALL;
+            else if (strcmp(token, "skip_recorded") == 0)
+                ops->trace_policy = COVLIB_TRACE_POLICY_SKIP_RECORDED;
+            else if (strcmp(token, "head") == 0)
+                ops->trace_policy = COVLIB_TRACE_POLICY_HEAD;
+            else
+                USAGE_CHECK(false, "invalid -trace_policy value (all, skip_recorded, head)");
+        } else if (strcmp(token, "-sample_interval") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -sample_interval milliseconds");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &ops->sample_interval) != 1 || ops->sample_interval == 0) {
+                USAGE_CHECK(false, "invalid -sample_interval milliseconds");
+            }
+        } else if (strcmp(token, "-stream") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing stream path");
+            ops->stream_path = argv[++i];
+        } else if (strcmp(token, "-dump_prefix") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing dump prefix");
+            ops->dump_prefix = argv[++i];
         } else if (strcmp(token, "-modules") == 0) {
             USAGE_CHECK((i + 1) < argc, "missing modules file");
             ops->modules_file = (char *) argv[++i];
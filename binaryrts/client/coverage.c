@@ -43,6 +43,8 @@
 #include "coverage.h"
 #include "hashtable.h"
 #include "modules.h"
+#include "stats.h"
+#include "stream.h"
 #include "utils.h"
 #include <stdint.h>
 
@@ -64,6 +66,7 @@
 
 #include <syscall.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 
 #endif
@@ -73,6 +76,7 @@
 typedef struct _bb_entry_t {
     uint offset;
     uint data; // NOTE: by default, this is the hit count of the BB. If we're dumping BB sizes, this will be the BB size.
+    bool ever_covered; // Survives hit count resets of runtime dumps, such that the final dump contains all covered BBs.
 } bb_entry_t;
 
 typedef struct _covered_mod_t {
@@ -86,13 +90,23 @@ typedef struct _coverage_data_t {
     drvector_t covered_modules; /* drvector of covered_mod_t */
 } coverage_data_t;
 
+typedef struct _dump_buffer_t {
+    char *data;
+    size_t size;
+    size_t capacity;
+} dump_buffer_t;
+
 typedef struct _dump_request_t {
     file_t dump_file;
+    dump_buffer_t *buffer;  /* If set, the dump is rendered into memory instead of the dump file (for streaming). */
     drvector_t bb_offsets;  /* BBs to dump (with hit count > 0) */
     bool reset;
+    bool include_ever_covered; /* Also dump BBs that were covered before any previous reset. */
     bool resolve_symbols;
     char *symbol_path;
     file_t syscalls_dump_file;
+    uint64 bytes_written;   /* Number of bytes written to the coverage dump file. */
+    uint64 bbs_dumped;      /* Number of BBs written to the coverage dump file. */
 } dump_request_t;
 
 typedef struct _bb_entry_iter_data_t {
@@ -104,6 +118,7 @@ typedef struct _bb_entry_iter_data_t {
 
 static covlib_options_t options;
 static char logdir[MAXIMUM_PATH];
+static char dump_prefix[MAXIMUM_FILENAME]; /* Prefix of dump files, e.g., of GoogleTest shards. */
 static file_t output_file;
 static coverage_data_t *global_data;
 static int covlib_init_count;
@@ -148,6 +163,65 @@ get_sysnum(const char* name)
 /* Dump coverage. */
 
 #define MAX_SYM_RESULT 256
+#define MAX_DUMP_LINE (2 * MAXIMUM_PATH + MAX_SYM_RESULT + 64)
+#define INIT_DUMP_BUFFER_SIZE (64 * 1024)
+
+static void
+dump_buffer_init(dump_buffer_t *buffer) {
+    buffer->data = dr_global_alloc(INIT_DUMP_BUFFER_SIZE);
+    buffer->size = 0;
+    buffer->capacity = INIT_DUMP_BUFFER_SIZE;
+}
+
+static void
+dump_buffer_delete(dump_buffer_t *buffer) {
+    dr_global_free(buffer->data, buffer->capacity);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+static void
+dump_buffer_append(dump_buffer_t *buffer, const void *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity * 2;
+        while (buffer->size + size > capacity)
+            capacity *= 2;
+        char *grown = dr_global_alloc(capacity);
+        memcpy(grown, buffer->data, buffer->size);
+        dr_global_free(buffer->data, buffer->capacity);
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+/*
+ * Writes to either the in-memory dump buffer or the dump file of the request.
+ */
+static void
+dump_write(dump_request_t *request, const void *data, size_t size) {
+    if (request->buffer != NULL) {
+        dump_buffer_append(request->buffer, data, size);
+        request->bytes_written += size;
+        return;
+    }
+    ssize_t written = dr_write_file(request->dump_file, data, size);
+    if (written > 0)
+        request->bytes_written += written;
+}
+
+static void
+dump_printf(dump_request_t *request, const char *fmt, ...) {
+    char line[MAX_DUMP_LINE];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = dr_vsnprintf(line, BUFFER_SIZE_ELEMENTS(line), fmt, ap);
+    va_end(ap);
+    /* dr_vsnprintf returns -1 if the line got truncated. */
+    dump_write(request, line, len < 0 ? BUFFER_SIZE_ELEMENTS(line) : (size_t) len);
+}
 
 static bool
 lookup_symbol(const char *symbol_path, bb_entry_t *bb_entry, OUT char *file, OUT uint64 *line, OUT char *name) {
@@ -174,22 +248,25 @@ dump_bb_entry(ptr_uint_t idx, void *entry, void *user_data) {
     bb_entry_t *bb_entry = (bb_entry_t *) entry;
     dump_request_t *request = (dump_request_t *) user_data;
 
-    if (bb_entry->data > 0 || options.dump_bb_size) {
+    if (bb_entry->data > 0 || options.dump_bb_size || (request->include_ever_covered && bb_entry->ever_covered)) {
         if (request->resolve_symbols) {
             char file[MAXIMUM_PATH];
             char name[MAX_SYM_RESULT];
             uint64 line;
             if (request->symbol_path && lookup_symbol(request->symbol_path, bb_entry, file, &line, name)) {
-                dr_fprintf(request->dump_file,
-                           "\t+0x%I64x" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%u\n",
-                           bb_entry->offset, file, name, line);
+                dump_printf(request,
+                            "\t+0x%I64x" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%u\n",
+                            bb_entry->offset, file, name, line);
             }
         } else if (options.text_dump) {
-            dr_fprintf(request->dump_file, "\t+0x%I64x\t%u\n", bb_entry->offset, bb_entry->data);
+            dump_printf(request, "\t+0x%I64x\t%u\n", bb_entry->offset, bb_entry->data);
         } else {
             drvector_append(&request->bb_offsets, (void *) (uintptr_t) bb_entry->offset);
         }
+        request->bbs_dumped++;
         if (request->reset) {
+            if (bb_entry->data > 0)
+                bb_entry->ever_covered = true;
             bb_entry->data = 0;
         }
     }
@@ -211,7 +288,7 @@ dump_coverage_table(void *drcontext, coverage_data_t *data, dump_request_t *requ
         ASSERT(mod_entry != NULL, "failed to get module");
         uint64 entries = mod_entry->bb_table.entries;
         if (entries > 0) {
-            dr_fprintf(request->dump_file, "%s" NON_FILE_PATH_SEP "%s\n", mod_entry->mod_name, mod_entry->mod_path);
+            dump_printf(request, "%s" NON_FILE_PATH_SEP "%s\n", mod_entry->mod_name, mod_entry->mod_path);
             if (!options.text_dump) {
                 drvector_init(&request->bb_offsets, entries, false, NULL);
             }
@@ -226,10 +303,9 @@ dump_coverage_table(void *drcontext, coverage_data_t *data, dump_request_t *requ
                 }
             }
             if (!options.text_dump) {
-                dr_fprintf(request->dump_file, "\tBBs: %d\n", request->bb_offsets.entries);
-                dr_write_file(request->dump_file, request->bb_offsets.array,
-                              request->bb_offsets.entries * sizeof(void *));
-                dr_fprintf(request->dump_file, "\n");
+                dump_printf(request, "\tBBs: %d\n", request->bb_offsets.entries);
+                dump_write(request, request->bb_offsets.array, request->bb_offsets.entries * sizeof(void *));
+                dump_write(request, "\n", 1);
                 drvector_delete(&request->bb_offsets);
             }
         }
@@ -241,7 +317,7 @@ dump_coverage_table(void *drcontext, coverage_data_t *data, dump_request_t *requ
 
 static void
 dump_coverage_data(void *drcontext, coverage_data_t *data, dump_request_t *request) {
-    if (request->dump_file == INVALID_FILE) {
+    if (request->buffer == NULL && request->dump_file == INVALID_FILE) {
         ASSERT(false, "invalid log file");
         return;
     }
@@ -285,6 +361,7 @@ typedef enum {
 static void
 free_bb_entry(void *bb_entry) {
     dr_global_free(bb_entry, sizeof(bb_entry_t));
+    stats_heap_free(sizeof(bb_entry_t));
 }
 
 static bb_entry_status_t
@@ -314,6 +391,8 @@ add_bb_coverage_entry(void *drcontext, coverage_data_t *data, app_pc start, bb_e
         if (covered_mod_entry == NULL) {
             covered_mod_entry = (covered_mod_t *) dr_global_alloc(sizeof(*covered_mod_entry));
             ASSERT(covered_mod_entry != NULL, "failed to allocate covered module");
+            stats_heap_alloc(sizeof(*covered_mod_entry));
+            stats_inc(drcontext, STAT_MODULES_COVERED);
             covered_mod_entry->mod_id = mod_id;
             covered_mod_entry->mod_name = mod_name;
             covered_mod_entry->mod_path = mod_path;
@@ -331,23 +410,142 @@ add_bb_coverage_entry(void *drcontext, coverage_data_t *data, app_pc start, bb_e
             *bb_entry = hashtable_lookup(&covered_mod_entry->bb_table, (void *) (ptr_uint_t) offset);
             /* If existing BB found, return it right away. */
             if (*bb_entry != NULL) {
+                stats_inc(drcontext, STAT_BB_EXISTING);
                 return BB_EXISTS;
             }
         }
         *bb_entry = (bb_entry_t *) dr_global_alloc(sizeof(bb_entry_t));
         (*bb_entry)->offset = offset;
         (*bb_entry)->data = 0;
+        (*bb_entry)->ever_covered = false;
+        stats_heap_alloc(sizeof(bb_entry_t));
+        uint table_bits = covered_mod_entry->bb_table.table_bits;
         hashtable_add(&covered_mod_entry->bb_table, (void *) (ptr_uint_t) offset, (void *) *bb_entry);
+        if (covered_mod_entry->bb_table.table_bits != table_bits)
+            stats_inc(drcontext, STAT_BB_TABLE_RESIZES);
+        stats_inc(drcontext, STAT_BB_NEW);
         return NEW_BB;
     }
+    stats_inc(drcontext, STAT_BB_NOT_FOUND);
     return BB_NOT_FOUND;
 }
 
+/* PC sampling. */
+
+static void *sample_lock;
+static void *sampler_exited; /* Signaled by the sampler thread when it has left its loop. */
+static volatile bool sampling_active;
+
+/*
+ * Suspends all application threads, records their current PCs, and resumes them.
+ * PCs are only mapped to modules after resuming, as suspended threads might hold the module table lock.
+ */
+static void
+sample_thread_pcs(void *drcontext) {
+    void **drcontexts = NULL;
+    uint num_suspended = 0;
+    uint num_unsuspended = 0;
+    if (!dr_suspend_all_other_threads_ex(&drcontexts, &num_suspended, &num_unsuspended, 0))
+        return;
+    if (num_suspended == 0) {
+        dr_resume_all_other_threads(drcontexts, num_suspended);
+        return;
+    }
+
+    app_pc *pcs = (app_pc *) dr_thread_alloc(drcontext, num_suspended * sizeof(app_pc));
+    uint num_pcs = 0;
+    uint i;
+    for (i = 0; i < num_suspended; i++) {
+        dr_mcontext_t mc = {sizeof(mc), DR_MC_CONTROL};
+        if (dr_get_mcontext(drcontexts[i], &mc))
+            pcs[num_pcs++] = mc.pc;
+    }
+    dr_resume_all_other_threads(drcontexts, num_suspended);
+
+    dr_mutex_lock(sample_lock);
+    for (i = 0; i < num_pcs; i++) {
+        bb_entry_t *bb_entry = NULL;
+        add_bb_coverage_entry(drcontext, global_data, pcs[i], &bb_entry);
+        if (bb_entry != NULL)
+            bb_entry->data += 1;
+    }
+    dr_mutex_unlock(sample_lock);
+    dr_thread_free(drcontext, pcs, num_suspended * sizeof(app_pc));
+}
+
+static void
+sampler_thread_main(void *arg) {
+    void *drcontext = dr_get_current_drcontext();
+    /* Not suspended at process exit, such that covlib_exit can wait for the sampler to stop. */
+    dr_client_thread_set_suspendable(false);
+    NOTIFY(1, "PC sampler started with an interval of %ums\n", options.sample_interval);
+    while (sampling_active) {
+        dr_sleep((int) options.sample_interval);
+        if (sampling_active)
+            sample_thread_pcs(drcontext);
+    }
+    dr_event_signal(sampler_exited);
+}
+
+/*
+ * Dumps must not iterate the coverage tables while the sampler adds entries.
+ */
+static void
+sample_lock_acquire(void) {
+    if (options.sample_interval > 0)
+        dr_mutex_lock(sample_lock);
+}
+
+static void
+sample_lock_release(void) {
+    if (options.sample_interval > 0)
+        dr_mutex_unlock(sample_lock);
+}
+
+/* Trace policies. */
+
+static void *incomplete_traces_lock;
+static hashtable_t incomplete_traces; /* Tags of traces without increments for some constituent BBs. */
+
+static void
+record_incomplete_trace(void *tag) {
+    dr_mutex_lock(incomplete_traces_lock);
+    hashtable_add(&incomplete_traces, tag, tag);
+    dr_mutex_unlock(incomplete_traces_lock);
+}
+
+/*
+ * Removes all traces that skipped increments (see -trace_policy), as they would hide BBs from the next dump once the
+ * hit counts are reset. Control does not enter these traces after this returns, hence their BBs execute stand-alone
+ * (probed) until they are part of a new trace. Must be called from a clean call without holding any lock.
+ */
+static void
+unlink_incomplete_traces(void *drcontext) {
+    drvector_t tags;
+    uint i;
+    dr_mutex_lock(incomplete_traces_lock);
+    drvector_init(&tags, incomplete_traces.entries + 1, false, NULL);
+    for (i = 0; i < HASHTABLE_SIZE(incomplete_traces.table_bits); i++) {
+        hash_entry_t *e;
+        for (e = incomplete_traces.table[i]; e != NULL; e = e->next)
+            drvector_append(&tags, e->payload);
+    }
+    hashtable_clear(&incomplete_traces);
+    dr_mutex_unlock(incomplete_traces_lock);
+    for (i = 0; i < tags.entries; i++) {
+        /* Flushes every fragment containing the trace head, i.e., the trace and the head BB. */
+        if (dr_unlink_flush_region((app_pc) drvector_get_entry(&tags, i), 1))
+            stats_inc(drcontext, STAT_TRACE_FLUSHES);
+    }
+    drvector_delete(&tags);
+}
+
 static void
 destroy_covered_module(void *entry) {
     covered_mod_t *cov_mod_entry = (covered_mod_t *) entry;
     hashtable_delete(&cov_mod_entry->bb_table);
     dr_global_free(cov_mod_entry, sizeof(*cov_mod_entry));
+    stats_heap_free(sizeof(*cov_mod_entry));
 }
 
 #define INIT_COVERED_MOD_ENTRIES 1024
@@ -445,39 +643,71 @@ event_pre_syscall(void *drcontext, int sysnum) {
 */
 static void
 event_annotation(void *data) {
+    uint64 dump_start = dr_get_microseconds();
     dump_count += 1;
     char *dump_id = (char *) data;
-    // Create dump file containing the coverage information.
     char fname[MAXIMUM_FILENAME];
-    dr_snprintf(fname, MAXIMUM_FILENAME, "%d.log", dump_count);
-    file_t dump_file = open_file(logdir, fname, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
+    dr_snprintf(fname, MAXIMUM_FILENAME, "%s%d.log", dump_prefix, dump_count);
+    // When streaming, the dump is rendered into memory and sent as a single frame, otherwise
+    // we create a dump file containing the coverage information.
+    bool streaming = stream_enabled();
+    dump_buffer_t buffer;
+    file_t dump_file = INVALID_FILE;
+    if (streaming)
+        dump_buffer_init(&buffer);
+    else
+        dump_file = open_file(logdir, fname, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
     file_t syscalls_dump_file = INVALID_FILE;
     if (options.syscalls) {
         // Create dump file containing the syscalls information.
         char syscalls_fname[MAXIMUM_FILENAME];
-        dr_snprintf(syscalls_fname, MAXIMUM_FILENAME, "%d.log.syscalls", dump_count);
+        dr_snprintf(syscalls_fname, MAXIMUM_FILENAME, "%s%d.log.syscalls", dump_prefix, dump_count);
         syscalls_dump_file = open_file(logdir, syscalls_fname, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
     }
     dump_request_t request = {
             .dump_file = dump_file,
+            .buffer = streaming ? &buffer : NULL,
             .reset = true,
+            .include_ever_covered = false,
             .resolve_symbols = options.resolve_symbols,
             .symbol_path = NULL,
-            .syscalls_dump_file = syscalls_dump_file
+            .syscalls_dump_file = syscalls_dump_file,
+            .bytes_written = 0,
+            .bbs_dumped = 0
     };
+    sample_lock_acquire();
     dump_coverage_data(NULL, global_data, &request);
-    dr_close_file(dump_file);
+    sample_lock_release();
+    /* Traces built before this dump omit increments of BBs that were hit before the reset (see -trace_policy). */
+    if (options.trace_policy != COVLIB_TRACE_POLICY_ALL)
+        unlink_incomplete_traces(dr_get_current_drcontext());
+    bool streamed = false;
+    if (streaming) {
+        streamed = stream_send_dump(dump_prefix, dump_count, dump_id, buffer.data, buffer.size);
+        if (!streamed) {
+            // Do not lose the dump if the consumer went away.
+            dump_file = open_file(logdir, fname, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
+            if (dump_file != INVALID_FILE)
+                dr_write_file(dump_file, buffer.data, buffer.size);
+        }
+        dump_buffer_delete(&buffer);
+    }
+    if (dump_file != INVALID_FILE)
+        dr_close_file(dump_file);
     if (options.syscalls && syscalls_dump_file != INVALID_FILE) {
         dr_close_file(syscalls_dump_file);
     }
-    // Create or append to dump lookup file.
-    file_t dump_lookup_file = open_file(logdir, DUMP_LOOKUP_FILE, DR_FILE_WRITE_APPEND | DR_FILE_ALLOW_LARGE);
-    if (dump_lookup_file == INVALID_FILE) {
-        ASSERT(false, "invalid lookup log file");
-        return;
+    // Create or append to dump lookup file (the consumer of the stream keeps track of dump IDs itself).
+    if (!streamed) {
+        file_t dump_lookup_file = open_file(logdir, DUMP_LOOKUP_FILE, DR_FILE_WRITE_APPEND | DR_FILE_ALLOW_LARGE);
+        if (dump_lookup_file == INVALID_FILE) {
+            ASSERT(false, "invalid lookup log file");
+            return;
+        }
+        dr_fprintf(dump_lookup_file, "%s%d;%s\n", dump_prefix, dump_count, dump_id);
+        dr_close_file(dump_lookup_file);
     }
-    dr_fprintf(dump_lookup_file, "%d;%s\n", dump_count, dump_id);
-    dr_close_file(dump_lookup_file);
+    stats_record_dump(dump_id, dr_get_microseconds() - dump_start, request.bytes_written, request.bbs_dumped);
 }
 
 /*
@@ -499,6 +729,10 @@ event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
     if (translating)
         return DR_EMIT_DEFAULT;
 
+    /* Each constituent BB of a trace has already been recorded when it was built as a stand-alone BB. */
+    if (for_trace)
+        return DR_EMIT_DEFAULT;
+
     app_pc start_pc;
     start_pc = dr_fragment_app_pc(tag);
     bb_entry_t *bb_entry = NULL;
@@ -528,12 +762,28 @@ event_bb_instrumentation(void *drcontext, void *tag, instrlist_t *bb, instr_t *i
     if (!drmgr_is_first_instr(drcontext, instr))
         return DR_EMIT_DEFAULT;
 
+    /* With the head policy, we can decide without looking up the BB entry. */
+    if (for_trace && options.trace_policy == COVLIB_TRACE_POLICY_HEAD && !dr_trace_head_at(drcontext, tag)) {
+        if (!translating)
+            record_incomplete_trace(tag);
+        stats_inc(drcontext, STAT_TRACE_PROBES_SKIPPED);
+        return DR_EMIT_DEFAULT;
+    }
+
     app_pc start_pc;
     start_pc = dr_fragment_app_pc(tag);
 
     bb_entry_t *bb_entry = NULL;
     bb_entry_status_t res = add_bb_coverage_entry(drcontext, global_data, start_pc, &bb_entry);
 
+    if (for_trace && options.trace_policy == COVLIB_TRACE_POLICY_SKIP_RECORDED &&
+        res == BB_EXISTS && bb_entry != NULL && bb_entry->data > 0) {
+        if (!translating)
+            record_incomplete_trace(tag);
+        stats_inc(drcontext, STAT_TRACE_PROBES_SKIPPED);
+        return DR_EMIT_DEFAULT;
+    }
+
     if (res != BB_NOT_FOUND && bb_entry != NULL) {
 #ifdef VERBOSE
         instr_t* ins = NULL;
@@ -562,6 +812,8 @@ event_bb_instrumentation(void *drcontext, void *tag, instrlist_t *bb, instr_t *i
         dr_insert_clean_call(drcontext, bb, instr, (void*)clean_call, false, 1, OPND_CREATE_INTPTR(&(bb_entry->data)));
 #endif
 
+        stats_inc(drcontext, STAT_PROBES_INSERTED);
+
         /* Just to be sure, we increment the hit count here once in case our racy increment fails. */
         bb_entry->data += 1;
 
@@ -594,20 +846,50 @@ covlib_exit(void) {
         }
     }
 
+    /* Stop PC sampling and wait until the sampler acknowledges, such that a sample in progress finishes before
+     * the final dump and the sampler never touches the coverage tables or sample_lock after they are destroyed. */
+    if (sampling_active) {
+        sampling_active = false;
+        dr_event_wait(sampler_exited);
+    }
+
     /* Dump coverage. */
+    uint64 dump_start = dr_get_microseconds();
     dump_request_t request = {
             .dump_file = output_file,
+            .buffer = NULL,
             .reset = false,
+            .include_ever_covered = true,
             .resolve_symbols = options.resolve_symbols,
             .symbol_path = NULL,
-            .syscalls_dump_file = syscalls_dump_file
+            .syscalls_dump_file = syscalls_dump_file,
+            .bytes_written = 0,
+            .bbs_dumped = 0
     };
+    sample_lock_acquire();
     dump_coverage_data(NULL, global_data, &request);
+    sample_lock_release();
+    stats_record_dump(DEFAULT_COVERAGE_LOG, dr_get_microseconds() - dump_start, request.bytes_written,
+                      request.bbs_dumped);
+
+    /* Write stats after the final dump, but before coverage data is freed. */
+    stats_exit();
 
     /* Clean up global data and close handle to output file. */
     global_data_destroy(global_data);
+    if (options.sample_interval > 0) {
+        dr_mutex_destroy(sample_lock);
+        dr_event_destroy(sampler_exited);
+    }
+    if (options.trace_policy != COVLIB_TRACE_POLICY_ALL) {
+        hashtable_delete(&incomplete_traces);
+        dr_mutex_destroy(incomplete_traces_lock);
+    }
     dr_close_file(output_file);
 
+    /* Close coverage stream. */
+    stream_exit();
+
     /* Destroy module table. */
     modtrack_exit();
 
@@ -637,6 +919,11 @@ event_init(void) {
         max_elide_call != 0)
         return COVLIB_ERROR_INVALID_SETUP;
 
+    /* set up self-instrumentation (no-op unless enabled), after the dump prefix is known */
+    res = stats_init(&options, dump_prefix);
+    if (res != COVLIB_SUCCESS)
+        return res;
+
     /* create module table */
     res = modtrack_init(&options);
     if (res != COVLIB_SUCCESS)
@@ -645,6 +932,12 @@ event_init(void) {
     /* Create global coverage object. */
     global_data = global_data_create();
 
+    /* Keep track of traces without increments for some BBs (if not all BBs of traces are probed). */
+    if (options.trace_policy != COVLIB_TRACE_POLICY_ALL) {
+        incomplete_traces_lock = dr_mutex_create();
+        hashtable_init_ex(&incomplete_traces, 8, HASH_INTPTR, false, false, NULL, NULL, NULL);
+    }
+
     /* Init vector for opened files (if tracing syscalls). */
     if (options.syscalls) {
         drvector_init(&opened_files, INIT_OPENED_FILES, true, free_opened_file);
@@ -654,13 +947,54 @@ event_init(void) {
     if (options.logname) {
         output_file = dr_open_file(options.logname, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
     } else {
-        output_file = open_file(logdir, DEFAULT_COVERAGE_LOG, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
+        char fname[MAXIMUM_FILENAME];
+        dr_snprintf(fname, MAXIMUM_FILENAME, "%s" DEFAULT_COVERAGE_LOG, dump_prefix);
+        NULL_TERMINATE_BUFFER(fname);
+        output_file = open_file(logdir, fname, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
     }
     ASSERT(output_file != INVALID_FILE, "invalid logfile");
 
+    /* Open coverage stream (falls back to dump files on failure). */
+    if (options.stream_path != NULL)
+        stream_init(options.stream_path);
+
+    /* Start PC sampler thread. */
+    if (options.sample_interval > 0) {
+        sample_lock = dr_mutex_create();
+        sampler_exited = dr_event_create();
+        sampling_active = true;
+        if (!dr_create_client_thread(sampler_thread_main, NULL)) {
+            sampling_active = false;
+            return COVLIB_ERROR;
+        }
+    }
+
     return COVLIB_SUCCESS;
 }
 
+/*
+ * Shards of a GoogleTest binary usually share the log directory, hence their dumps are prefixed with the shard index.
+ */
+static void
+init_dump_prefix(void) {
+    dump_prefix[0] = '\0';
+    if (options.dump_prefix != NULL) {
+        dr_snprintf(dump_prefix, BUFFER_SIZE_ELEMENTS(dump_prefix), "%s", options.dump_prefix);
+    }
+#ifdef UNIX
+    else {
+        const char *total_shards = getenv("GTEST_TOTAL_SHARDS");
+        const char *shard_index = getenv("GTEST_SHARD_INDEX");
+        int total = 0;
+        if (total_shards != NULL && shard_index != NULL && dr_sscanf(total_shards, "%d", &total) == 1 && total > 1)
+            dr_snprintf(dump_prefix, BUFFER_SIZE_ELEMENTS(dump_prefix), "shard%s_", shard_index);
+    }
+#endif
+    NULL_TERMINATE_BUFFER(dump_prefix);
+    if (dump_prefix[0] != '\0')
+        NOTIFY(1, "Prefixing dumps with %s\n", dump_prefix);
+}
+
 covlib_status_t
 covlib_init(covlib_options_t *ops) {
     int count = dr_atomic_add32_return_sum(&covlib_init_count, 1);
@@ -693,16 +1027,24 @@ covlib_init(covlib_options_t *ops) {
     }
     NULL_TERMINATE_BUFFER(logdir);
     options.logdir = logdir;
+    init_dump_prefix();
 
     drmgr_init();
     drx_init();
     drreg_options_t reg_ops = {sizeof(reg_ops), 2 /*max slots needed: aflags*/, false};
     drreg_init(&reg_ops);
 
-    /* Add instrumentation handler (called whenever a new BB is loaded into DR code cache). */
-    if (options.runtime_dump) {
+    /* Add instrumentation handler (called whenever a new BB is loaded into DR code cache).
+     * When sampling PCs, no BB gets recorded or instrumented, the sampler thread fills the coverage tables. */
+    if (options.sample_interval > 0) {
+        NOTIFY(1, "Sampling PCs instead of recording BBs\n", NULL);
+    } else if (options.runtime_dump) {
         drmgr_register_bb_instrumentation_event(NULL, event_bb_instrumentation, NULL);
+    } else {
+        drmgr_register_bb_instrumentation_event(event_bb_analysis, NULL, NULL);
+    }
 
+    if (options.runtime_dump) {
         /* Annotations are a means of communication for dumping coverage from the application. */
         dr_annotation_register_call(
                 "dynamorio_annotate_log",
@@ -710,8 +1052,6 @@ covlib_init(covlib_options_t *ops) {
                 false,
                 1,
                 DR_ANNOTATION_CALL_TYPE_FASTCALL);
-    } else {
-        drmgr_register_bb_instrumentation_event(event_bb_analysis, NULL, NULL);
     }
 
     if (options.syscalls) {
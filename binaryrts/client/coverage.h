@@ -56,6 +56,13 @@ typedef enum {
     COVLIB_ERROR_BUF_TOO_SMALL,         /* Operation failed: buffer too small. */
 } covlib_status_t;
 
+/* Specifies how BBs that are copied into DynamoRIO traces get instrumented (only relevant for runtime dumping). */
+typedef enum {
+    COVLIB_TRACE_POLICY_ALL,            /* Every constituent BB of a trace keeps its hit count increment. */
+    COVLIB_TRACE_POLICY_SKIP_RECORDED,  /* Constituent BBs that have already been hit get no increment. */
+    COVLIB_TRACE_POLICY_HEAD,           /* Only the BB at the trace head gets an increment. */
+} covlib_trace_policy_t;
+
 /* Specifies the options when initializing covlib. */
 typedef struct _covlib_options_t {
     /** Set this to the size of this structure. */
@@ -87,6 +94,7 @@ typedef struct _covlib_options_t {
     /**
      * By default, all covered BBs are dumped when the process exits. This options enables runtime dumping by making use of DynamoRIO's annotation communication means.
      * Note: If runtime dumping is enabled, BBs get instrumented (i.e., modified), since after a dump, the hit counts are reset, but BBs are not reloaded into the code cache.
+     * The final dump on exit still contains the union of all BBs covered during the whole run.
      */
     bool runtime_dump;
 
@@ -112,6 +120,43 @@ typedef struct _covlib_options_t {
      * By default, no file-related syscalls are traced. This options enables tracing of file-related syscalls and outputs a list of opened files upon coverage dump.
      */
     bool syscalls;
+
+    /**
+     * By default, the client does not keep track of its own overhead. This option enables per-thread counters
+     * (e.g., module cache hits, new BBs) and per-dump timings, which are written to "coverage.stats.json" in the
+     * log directory. With -verbose, a summary is printed on exit.
+     */
+    bool stats;
+
+    /**
+     * By default, BBs inside DynamoRIO traces are instrumented just like stand-alone BBs (COVLIB_TRACE_POLICY_ALL).
+     * The other policies avoid re-inserting hit count increments into hot traces. To not miss BBs that are only
+     * executed inside traces after a runtime dump has reset their hit counts, each runtime dump removes the traces
+     * that skipped increments, such that they are rebuilt from (probed) stand-alone BBs during the next test.
+     */
+    covlib_trace_policy_t trace_policy;
+
+    /**
+     * By default, every BB is recorded (or instrumented) when it is loaded into the code cache. If this is set to
+     * a non-zero value (in milliseconds), no BB is instrumented at all. Instead, a client thread periodically
+     * samples the PCs of all application threads and records them in the coverage tables. This only yields an
+     * under-approximation of the covered code, but is suitable for long-running tests with function-level RTS.
+     */
+    uint sample_interval;
+
+    /**
+     * By default, runtime dumps are written to "N.log" files in the log directory. This option allows passing
+     * the path of a FIFO (or named pipe on Windows), to which each dump is streamed as a single frame instead.
+     * This way, a consumer (e.g., the resolver with -stream) can process dumps while the next test runs.
+     */
+    const char *stream_path;
+
+    /**
+     * By default, dump files are named "N.log" (and listed as "N" in "dump-lookup.log"), unless GoogleTest sharding
+     * is enabled (GTEST_TOTAL_SHARDS > 1, Linux only), in which case they are prefixed with "shard<GTEST_SHARD_INDEX>_",
+     * such that shards can share the log directory. This option sets the prefix explicitly.
+     */
+    const char *dump_prefix;
 } covlib_options_t;
 
 /* Library interface. */
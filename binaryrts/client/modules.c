@@ -39,6 +39,8 @@
 #define OUT DR_PARAM_OUT
 #endif
 #include "modules.h"
+#include "filter.h"
+#include "stats.h"
 #include "utils.h"
 #include <string.h>
 
@@ -92,7 +94,7 @@ static covlib_options_t options;
 static int modtrack_init_count;
 static int tls_idx = -1;
 static module_table_t module_table;
-static drvector_t instrumented_modules; /* These are the modules that will be instrumented, if they are loaded. */
+static filter_t *module_filter; /* Patterns of the modules that will be instrumented, NULL for all modules. */
 
 /* Module data management. */
 
@@ -162,14 +164,15 @@ modtrack_lookup_helper(void *drcontext, app_pc pc, OUT uint *mod_index,
     /* We assume we never change an entry's data field, even on unload,
      * and thus it is ok to check its value without a lock.
      */
-    /* lookup thread module cache */
-    for (i = 0; i < NUM_THREAD_MODULE_CACHE; i++) {
+    /* lookup thread module cache (not available for client threads, e.g., the PC sampler) */
+    for (i = 0; data != NULL && i < NUM_THREAD_MODULE_CACHE; i++) {
         entry = data->cache[i];
         if (pc_is_in_module(entry, pc)) {
             if (i > 0) {
                 thread_module_cache_adjust(data->cache, entry, i,
                                            NUM_THREAD_MODULE_CACHE);
             }
+            stats_inc(drcontext, STAT_MOD_THREAD_CACHE_HIT);
             lookup_helper_set_fields(entry, mod_index, seg_base, mod_base, mod_name, mod_path);
             return COVLIB_SUCCESS;
         }
@@ -179,6 +182,7 @@ modtrack_lookup_helper(void *drcontext, app_pc pc, OUT uint *mod_index,
     for (i = 0; i < NUM_GLOBAL_MODULE_CACHE; i++) {
         entry = module_table.cache[i];
         if (pc_is_in_module(entry, pc)) {
+            stats_inc(drcontext, STAT_MOD_GLOBAL_CACHE_HIT);
             lookup_helper_set_fields(entry, mod_index, seg_base, mod_base, mod_name, mod_path);
             return COVLIB_SUCCESS;
         }
@@ -191,7 +195,8 @@ modtrack_lookup_helper(void *drcontext, app_pc pc, OUT uint *mod_index,
         ASSERT(entry != NULL, "fail to get module entry");
         if (pc_is_in_module(entry, pc)) {
             global_module_cache_add(module_table.cache, entry);
-            thread_module_cache_add(data->cache, NUM_THREAD_MODULE_CACHE, entry);
+            if (data != NULL)
+                thread_module_cache_add(data->cache, NUM_THREAD_MODULE_CACHE, entry);
             break;
         }
         entry = NULL;
@@ -199,6 +204,7 @@ modtrack_lookup_helper(void *drcontext, app_pc pc, OUT uint *mod_index,
     if (entry != NULL)
         lookup_helper_set_fields(entry, mod_index, seg_base, mod_base, mod_name, mod_path);
     drvector_unlock(&module_table.vector);
+    stats_inc(drcontext, entry == NULL ? STAT_MOD_TABLE_MISS : STAT_MOD_TABLE_HIT);
     return entry == NULL ? COVLIB_ERROR_NOT_FOUND : COVLIB_SUCCESS;
 }
 
@@ -208,52 +214,50 @@ modtrack_lookup_segment(void *drcontext, app_pc pc, OUT uint *segment_index,
     return modtrack_lookup_helper(drcontext, pc, segment_index, segment_base, NULL, mod_name, mod_path);
 }
 
-#define MAX_MODULE_NAME 128
-
-static void
-free_instrumented_module(void *tofree) {
-    dr_global_free(tofree, MAX_MODULE_NAME);
-}
-
 static void
 init_instrumented_modules(const char *file) {
-    drvector_init(&instrumented_modules, 16, false, free_instrumented_module);
-    if (file != NULL) {
-        if (instrumented_modules.entries == 0) {
-            file_t modules_file = dr_open_file(file, DR_FILE_READ | DR_FILE_ALLOW_LARGE);
-            if (modules_file == INVALID_FILE) {
-                NOTIFY(0, "Modules file at %s could not be opened, falling back to instrumenting all modules.\n", file);
-            } else {
-                const char *map, *ptr;
-                size_t map_size;
-                uint64 file_size;
-                if (dr_file_size(modules_file, &file_size)) {
-                    map_size = (size_t) file_size;
-                    map = (char *) dr_map_file(modules_file, &map_size, 0, NULL, DR_MEMPROT_READ, 0);
-                    if (map != NULL && (size_t) file_size <= map_size) {
-                        for (ptr = map; ptr < map + file_size;) {
-                            char *module_name = dr_global_alloc(MAX_MODULE_NAME);
-                            if (dr_sscanf(ptr, "%s\n", module_name) != 1) {
-                                // We reached the end, clean up and break.
-                                dr_global_free(module_name, MAX_MODULE_NAME);
-                                break;
-                            }
-                            null_terminate_path(module_name);
-                            drvector_append(&instrumented_modules, module_name);
-                            ptr = get_next_line(ptr);
-                        }
-                    } else {
-                        NOTIFY(0, "Failed to map file %s\n", modules_file);
-                    }
-                } else {
-                    NOTIFY(0, "Failed to get input file size for %s\n", file);
-                }
+    if (file == NULL)
+        return;
+    if (module_filter != NULL) {
+        NOTIFY(0, "Skipping to parse modules, since modules file was already parsed.\n", 0);
+        return;
+    }
+    file_t modules_file = dr_open_file(file, DR_FILE_READ | DR_FILE_ALLOW_LARGE);
+    if (modules_file == INVALID_FILE) {
+        NOTIFY(0, "Modules file at %s could not be opened, falling back to instrumenting all modules.\n", file);
+        return;
+    }
+    uint64 file_size;
+    if (dr_file_size(modules_file, &file_size)) {
+        size_t map_size = (size_t) file_size;
+        const char *map = (char *) dr_map_file(modules_file, &map_size, 0, NULL, DR_MEMPROT_READ, 0);
+        if (map != NULL && (size_t) file_size <= map_size) {
+            /* Module names (or glob patterns) are compiled once, such that module loads are cheap to filter. */
+            filter_allocator_t allocator = { dr_global_alloc, dr_global_free };
+            size_t text_size = (size_t) file_size + 1;
+            char *text = dr_global_alloc(text_size);
+            memcpy(text, map, (size_t) file_size);
+            text[file_size] = '\0';
+            module_filter = filter_create(&allocator, FILTER_PLAIN_EXACT);
+            if (module_filter == NULL || !filter_add_list(module_filter, text, '\n') ||
+                !filter_compile(module_filter)) {
+                NOTIFY(0, "Failed to compile modules from %s, falling back to instrumenting all modules.\n", file);
+                filter_destroy(module_filter);
+                module_filter = NULL;
+            } else if (filter_size(module_filter) == 0) {
+                filter_destroy(module_filter);
+                module_filter = NULL;
             }
-            dr_close_file(modules_file);
+            dr_global_free(text, text_size);
         } else {
-            NOTIFY(0, "Skipping to parse modules, since modules file was already parsed.\n", 0);
+            NOTIFY(0, "Failed to map file %s\n", file);
         }
+        if (map != NULL)
+            dr_unmap_file((void *) map, map_size);
+    } else {
+        NOTIFY(0, "Failed to get input file size for %s\n", file);
     }
+    dr_close_file(modules_file);
 }
 
 /* Event callbacks. */
@@ -282,21 +286,12 @@ event_module_unload(void *drcontext, const module_data_t *data) {
 static void
 event_module_load(void *drcontext, const module_data_t *data, bool loaded) {
     bool instrument_module = false;
-    if (instrumented_modules.entries > 0) {
-        uint i;
-        char *entry;
+    if (module_filter != NULL) {
         const char *module_name = dr_module_preferred_name(data);
-        for (i = 0; i < instrumented_modules.entries; i++) {
-            entry = drvector_get_entry(&instrumented_modules, i);
-            ASSERT(entry != NULL, "failed to get instrumented module entry");
-            if (strcmp(entry, module_name) == 0) {
-                instrument_module = true;
-                break;
-            }
-        }
+        instrument_module = module_name != NULL && filter_matches(module_filter, module_name);
         dr_module_set_should_instrument(data->handle, instrument_module);
     }
-    if (instrument_module || instrumented_modules.entries == 0) {
+    if (instrument_module || module_filter == NULL) {
         module_entry_t *entry = NULL;
         module_data_t *mod;
         int i;
@@ -400,7 +395,8 @@ modtrack_exit(void) {
 
     drmgr_unregister_tls_field(tls_idx);
     drvector_delete(&module_table.vector);
-    drvector_delete(&instrumented_modules);
+    filter_destroy(module_filter);
+    module_filter = NULL;
     drmgr_exit();
 
     return COVLIB_SUCCESS;
@@ -0,0 +1,273 @@
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drvector.h"
+#include "stats.h"
+#include "utils.h"
+
+/*
+ * Self-instrumentation for the BinaryRTS DynamoRIO client.
+ * See stats.h for the interface.
+ */
+
+#define STATS_LOG "coverage.stats.json"
+#define INIT_THREAD_ENTRIES 64
+#define MAX_ESCAPED_DUMP_ID 512
+
+/* Internal data structures. */
+
+typedef struct _thread_stats_t {
+    uint64 counters[STAT_COUNTER_MAX];
+} thread_stats_t;
+
+static const char *counter_names[STAT_COUNTER_MAX] = {
+        "bb_new",
+        "bb_existing",
+        "bb_not_found",
+        "bb_table_resizes",
+        "modules_covered",
+        "probes_inserted",
+        "trace_probes_skipped",
+        "trace_flushes",
+        "mod_thread_cache_hit",
+        "mod_global_cache_hit",
+        "mod_table_hit",
+        "mod_table_miss",
+};
+
+/* Variables for this translation unit. */
+
+static bool enabled;
+static int tls_idx = -1;
+static void *stats_lock;
+static drvector_t live_threads; /* thread_stats_t of running threads, NULL slots are re-used. */
+static uint64 merged_counters[STAT_COUNTER_MAX];
+static uint64 heap_current;
+static uint64 heap_peak;
+static uint64 dump_count;
+static uint64 dump_total_us;
+static uint64 dump_max_us;
+static uint64 dump_total_bytes;
+static uint64 dump_total_bbs;
+static file_t stats_file = INVALID_FILE;
+
+/* Helpers. */
+
+static void
+merge_counters(uint64 *dst, const thread_stats_t *src) {
+    uint i;
+    for (i = 0; i < STAT_COUNTER_MAX; i++)
+        dst[i] += src->counters[i];
+}
+
+/*
+ * Escapes quotes, backslashes and control characters, such that dump identifiers are valid JSON strings.
+ */
+static void
+json_escape(const char *src, char *dst, size_t dst_size) {
+    size_t pos = 0;
+    for (; *src != '\0' && pos + 2 < dst_size; src++) {
+        if (*src == '"' || *src == '\\') {
+            dst[pos++] = '\\';
+            dst[pos++] = *src;
+        } else if ((unsigned char) *src < 0x20) {
+            dst[pos++] = ' ';
+        } else {
+            dst[pos++] = *src;
+        }
+    }
+    dst[pos] = '\0';
+}
+
+/* Event callbacks. */
+
+static void
+event_thread_init(void *drcontext) {
+    thread_stats_t *data = dr_global_alloc(sizeof(*data));
+    memset(data, 0, sizeof(*data));
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+
+    uint i;
+    dr_mutex_lock(stats_lock);
+    for (i = 0; i < live_threads.entries; i++) {
+        if (drvector_get_entry(&live_threads, i) == NULL)
+            break;
+    }
+    if (i < live_threads.entries)
+        drvector_set_entry(&live_threads, i, data);
+    else
+        drvector_append(&live_threads, data);
+    dr_mutex_unlock(stats_lock);
+}
+
+static void
+event_thread_exit(void *drcontext) {
+    thread_stats_t *data = (thread_stats_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (data == NULL)
+        return;
+
+    uint i;
+    dr_mutex_lock(stats_lock);
+    merge_counters(merged_counters, data);
+    for (i = 0; i < live_threads.entries; i++) {
+        if (drvector_get_entry(&live_threads, i) == data) {
+            drvector_set_entry(&live_threads, i, NULL);
+            break;
+        }
+    }
+    dr_mutex_unlock(stats_lock);
+
+    drmgr_set_tls_field(drcontext, tls_idx, NULL);
+    dr_global_free(data, sizeof(*data));
+}
+
+/* Library interface. */
+
+void
+stats_inc(void *drcontext, stat_counter_t counter) {
+    if (!enabled)
+        return;
+    if (drcontext == NULL)
+        drcontext = dr_get_current_drcontext();
+    thread_stats_t *data = (thread_stats_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (data != NULL)
+        data->counters[counter]++;
+}
+
+void
+stats_heap_alloc(size_t size) {
+    if (!enabled)
+        return;
+    dr_mutex_lock(stats_lock);
+    heap_current += size;
+    if (heap_current > heap_peak)
+        heap_peak = heap_current;
+    dr_mutex_unlock(stats_lock);
+}
+
+void
+stats_heap_free(size_t size) {
+    if (!enabled)
+        return;
+    dr_mutex_lock(stats_lock);
+    heap_current -= MIN(size, heap_current);
+    dr_mutex_unlock(stats_lock);
+}
+
+void
+stats_record_dump(const char *dump_id, uint64 micros, uint64 bytes, uint64 bbs) {
+    if (!enabled)
+        return;
+    char escaped_id[MAX_ESCAPED_DUMP_ID];
+    json_escape(dump_id == NULL ? "" : dump_id, escaped_id, BUFFER_SIZE_ELEMENTS(escaped_id));
+
+    dr_mutex_lock(stats_lock);
+    dump_count++;
+    dump_total_us += micros;
+    dump_total_bytes += bytes;
+    dump_total_bbs += bbs;
+    if (micros > dump_max_us)
+        dump_max_us = micros;
+    /* Dumps are streamed to the stats file right away, the file is completed in stats_exit. */
+    if (stats_file != INVALID_FILE) {
+        dr_fprintf(stats_file,
+                   "%s\n    {\"id\": \"%s\", \"us\": " UINT64_FORMAT_STRING ", \"bytes\": " UINT64_FORMAT_STRING
+                   ", \"bbs\": " UINT64_FORMAT_STRING "}",
+                   dump_count > 1 ? "," : "", escaped_id, micros, bytes, bbs);
+    }
+    dr_mutex_unlock(stats_lock);
+}
+
+covlib_status_t
+stats_init(covlib_options_t *ops, const char *dump_prefix) {
+    enabled = ops->stats;
+    if (!enabled)
+        return COVLIB_SUCCESS;
+
+    stats_lock = dr_mutex_create();
+    drvector_init(&live_threads, INIT_THREAD_ENTRIES, false, NULL);
+
+    tls_idx = drmgr_register_tls_field();
+    if (tls_idx == -1 ||
+        !drmgr_register_thread_init_event(event_thread_init) ||
+        !drmgr_register_thread_exit_event(event_thread_exit))
+        return COVLIB_ERROR;
+
+    char fname[MAXIMUM_FILENAME];
+    dr_snprintf(fname, BUFFER_SIZE_ELEMENTS(fname), "%s" STATS_LOG, dump_prefix);
+    NULL_TERMINATE_BUFFER(fname);
+    stats_file = open_file(ops->logdir, fname, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
+    if (stats_file == INVALID_FILE) {
+        NOTIFY(0, "Could not open stats file in %s, stats will only be printed.\n", ops->logdir);
+    } else {
+        dr_fprintf(stats_file, "{\n  \"process_id\": %d,\n  \"dumps\": [", dr_get_process_id());
+    }
+    return COVLIB_SUCCESS;
+}
+
+covlib_status_t
+stats_exit(void) {
+    if (!enabled)
+        return COVLIB_SUCCESS;
+
+    uint64 totals[STAT_COUNTER_MAX];
+    uint i;
+
+    dr_mutex_lock(stats_lock);
+    /* Threads that are still alive at process exit have not merged their counters yet. */
+    memcpy(totals, merged_counters, sizeof(totals));
+    for (i = 0; i < live_threads.entries; i++) {
+        thread_stats_t *data = (thread_stats_t *) drvector_get_entry(&live_threads, i);
+        if (data != NULL)
+            merge_counters(totals, data);
+    }
+
+    if (stats_file != INVALID_FILE) {
+        dr_fprintf(stats_file, "\n  ],\n  \"counters\": {");
+        for (i = 0; i < STAT_COUNTER_MAX; i++) {
+            dr_fprintf(stats_file, "%s\n    \"%s\": " UINT64_FORMAT_STRING, i > 0 ? "," : "", counter_names[i],
+                       totals[i]);
+        }
+        dr_fprintf(stats_file,
+                   "\n  },\n  \"heap\": {\"current_bytes\": " UINT64_FORMAT_STRING ", \"peak_bytes\": "
+                   UINT64_FORMAT_STRING "},\n",
+                   heap_current, heap_peak);
+        dr_fprintf(stats_file,
+                   "  \"dump_totals\": {\"count\": " UINT64_FORMAT_STRING ", \"us\": " UINT64_FORMAT_STRING
+                   ", \"max_us\": " UINT64_FORMAT_STRING ", \"bytes\": " UINT64_FORMAT_STRING ", \"bbs\": "
+                   UINT64_FORMAT_STRING "}\n}\n",
+                   dump_count, dump_total_us, dump_max_us, dump_total_bytes, dump_total_bbs);
+        dr_close_file(stats_file);
+        stats_file = INVALID_FILE;
+    }
+
+    /* DR's printf does not support floating point values, hence we report the hit rate in per mille. */
+    uint64 lookups = totals[STAT_MOD_THREAD_CACHE_HIT] + totals[STAT_MOD_GLOBAL_CACHE_HIT] +
+                     totals[STAT_MOD_TABLE_HIT] + totals[STAT_MOD_TABLE_MISS];
+    uint64 cache_hits = totals[STAT_MOD_THREAD_CACHE_HIT] + totals[STAT_MOD_GLOBAL_CACHE_HIT];
+    NOTIFY(1, "BinaryRTS client stats:\n"
+              "  BBs: " UINT64_FORMAT_STRING " new, " UINT64_FORMAT_STRING " existing, " UINT64_FORMAT_STRING
+              " outside modules, " UINT64_FORMAT_STRING " table resizes\n"
+              "  Module lookups: " UINT64_FORMAT_STRING " total, cache hit rate " UINT64_FORMAT_STRING " per mille\n"
+              "  Dumps: " UINT64_FORMAT_STRING " total, " UINT64_FORMAT_STRING "us total, " UINT64_FORMAT_STRING
+              "us max, " UINT64_FORMAT_STRING " bytes written\n"
+              "  Heap (coverage data): " UINT64_FORMAT_STRING " bytes peak\n",
+           totals[STAT_BB_NEW], totals[STAT_BB_EXISTING], totals[STAT_BB_NOT_FOUND], totals[STAT_BB_TABLE_RESIZES],
+           lookups, lookups == 0 ? 0 : cache_hits * 1000 / lookups,
+           dump_count, dump_total_us, dump_max_us, dump_total_bytes,
+           heap_peak);
+    dr_mutex_unlock(stats_lock);
+
+    enabled = false;
+    drmgr_unregister_thread_init_event(event_thread_init);
+    drmgr_unregister_thread_exit_event(event_thread_exit);
+    drmgr_unregister_tls_field(tls_idx);
+    for (i = 0; i < live_threads.entries; i++) {
+        thread_stats_t *data = (thread_stats_t *) drvector_get_entry(&live_threads, i);
+        if (data != NULL)
+            dr_global_free(data, sizeof(*data));
+    }
+    drvector_delete(&live_threads);
+    dr_mutex_destroy(stats_lock);
+
+    return COVLIB_SUCCESS;
+}
@@ -0,0 +1,73 @@
+#ifndef _CLIENT_STATS_H_
+#define _CLIENT_STATS_H_
+
+#include "dr_api.h"
+#include "coverage.h"
+
+/*
+ * Self-instrumentation for the BinaryRTS DynamoRIO client.
+ * Counters are kept per thread (no atomics on the event paths) and merged when a thread exits
+ * or when the client shuts down. Dumps are timed individually and streamed to the stats file,
+ * such that memory consumption does not grow with the number of dumps.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    STAT_BB_NEW,                /* BBs that got a new coverage entry. */
+    STAT_BB_EXISTING,           /* BBs that were (re-)built and already had a coverage entry. */
+    STAT_BB_NOT_FOUND,          /* BBs outside of any tracked module. */
+    STAT_BB_TABLE_RESIZES,      /* Resizes of per-module BB hashtables. */
+    STAT_MODULES_COVERED,       /* Modules that got a coverage table. */
+    STAT_PROBES_INSERTED,       /* Hit count increments inserted (runtime dumping). */
+    STAT_TRACE_PROBES_SKIPPED,  /* Hit count increments omitted in traces due to the trace policy. */
+    STAT_TRACE_FLUSHES,         /* Traces without increments for some BBs that were removed on runtime dumps. */
+    STAT_MOD_THREAD_CACHE_HIT,  /* Module lookups served by the thread-private cache. */
+    STAT_MOD_GLOBAL_CACHE_HIT,  /* Module lookups served by the global direct-mapped cache. */
+    STAT_MOD_TABLE_HIT,         /* Module lookups that required a locked module table scan. */
+    STAT_MOD_TABLE_MISS,        /* Module lookups that did not find any module. */
+    STAT_COUNTER_MAX
+} stat_counter_t;
+
+/*
+ * The stats file is prefixed with `dump_prefix`, such that clients sharing a log directory (e.g., GoogleTest shards)
+ * write separate files.
+ */
+covlib_status_t
+stats_init(covlib_options_t *ops, const char *dump_prefix);
+
+/*
+ * Increments a counter for the thread owning `drcontext` (may be NULL for the current thread).
+ * This is a no-op unless stats are enabled.
+ */
+void
+stats_inc(void *drcontext, stat_counter_t counter);
+
+/*
+ * Keeps track of the heap consumed by coverage data structures (current and peak bytes).
+ */
+void
+stats_heap_alloc(size_t size);
+
+void
+stats_heap_free(size_t size);
+
+/*
+ * Records a single coverage dump, with its latency, the number of bytes written, and the number of dumped BBs.
+ */
+void
+stats_record_dump(const char *dump_id, uint64 micros, uint64 bytes, uint64 bbs);
+
+/*
+ * Merges all per-thread counters, writes the stats file and (if verbose) prints a summary.
+ */
+covlib_status_t
+stats_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLIENT_STATS_H_ */
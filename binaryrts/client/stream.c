@@ -0,0 +1,120 @@
+#include "dr_api.h"
+#include "drmgr.h"
+#include "stream.h"
+#include "utils.h"
+
+#ifdef UNIX
+#include <signal.h>
+#endif
+
+/*
+ * Streaming of runtime coverage dumps to a local consumer.
+ * See stream.h for the frame format.
+ */
+
+/* Variables for this translation unit. */
+
+static file_t stream_file = INVALID_FILE;
+static void *stream_lock;
+static volatile thread_id_t sending_thread; /* Thread that is writing a frame (with stream_lock held), or 0. */
+
+/* Helpers. */
+
+static bool
+write_fully(const void *data, size_t size) {
+    const char *pos = (const char *) data;
+    while (size > 0) {
+        ssize_t written = dr_write_file(stream_file, pos, size);
+        if (written <= 0)
+            return false;
+        pos += written;
+        size -= written;
+    }
+    return true;
+}
+
+#ifdef UNIX
+/*
+ * Writing to the FIFO after the consumer exited raises SIGPIPE, whose default action would kill the application.
+ * While a frame is sent, it is suppressed, such that the write fails with EPIPE and the dump falls back to a file.
+ */
+static dr_signal_action_t
+event_signal(void *drcontext, dr_siginfo_t *info) {
+    if (info->sig == SIGPIPE && sending_thread != 0 && sending_thread == dr_get_thread_id(drcontext))
+        return DR_SIGNAL_SUPPRESS;
+    return DR_SIGNAL_DELIVER;
+}
+#endif
+
+/* Library interface. */
+
+covlib_status_t
+stream_init(const char *path) {
+    /* We do not create or truncate anything here, the consumer is responsible for creating the FIFO. */
+    stream_file = dr_open_file(path, DR_FILE_WRITE_ONLY);
+    if (stream_file == INVALID_FILE) {
+        NOTIFY(0, "Could not open coverage stream at %s, falling back to dump files.\n", path);
+        return COVLIB_ERROR_NOT_FOUND;
+    }
+    stream_lock = dr_mutex_create();
+#ifdef UNIX
+    drmgr_register_signal_event(event_signal);
+#endif
+    NOTIFY(1, "Streaming coverage dumps to %s\n", path);
+    return COVLIB_SUCCESS;
+}
+
+bool
+stream_enabled(void) {
+    return stream_file != INVALID_FILE;
+}
+
+bool
+stream_send_dump(const char *dump_prefix, uint dump_number, const char *dump_id, const char *payload,
+                 size_t payload_length) {
+    if (!stream_enabled())
+        return false;
+
+    stream_frame_header_t header;
+    header.magic = STREAM_FRAME_MAGIC;
+    header.version = STREAM_FRAME_VERSION;
+    header.dump_number = dump_number;
+    header.prefix_length = (uint) strlen(dump_prefix);
+    header.id_length = (uint) strlen(dump_id);
+    header.reserved = 0;
+    header.payload_length = payload_length;
+
+    /* Frames of concurrent dumps must not interleave. */
+    dr_mutex_lock(stream_lock);
+    sending_thread = dr_get_thread_id(dr_get_current_drcontext());
+    bool success = stream_file != INVALID_FILE &&
+                   write_fully(&header, sizeof(header)) &&
+                   write_fully(dump_prefix, header.prefix_length) &&
+                   write_fully(dump_id, header.id_length) &&
+                   write_fully(payload, payload_length);
+    sending_thread = 0;
+    if (!success && stream_file != INVALID_FILE) {
+        NOTIFY(0, "Coverage stream broken at dump %u, falling back to dump files.\n", dump_number);
+        dr_close_file(stream_file);
+        stream_file = INVALID_FILE;
+    }
+    dr_mutex_unlock(stream_lock);
+    return success;
+}
+
+void
+stream_exit(void) {
+    if (stream_lock == NULL)
+        return;
+    dr_mutex_lock(stream_lock);
+    if (stream_file != INVALID_FILE) {
+        dr_close_file(stream_file);
+        stream_file = INVALID_FILE;
+    }
+    dr_mutex_unlock(stream_lock);
+    dr_mutex_destroy(stream_lock);
+    stream_lock = NULL;
+#ifdef UNIX
+    drmgr_unregister_signal_event(event_signal);
+#endif
+}
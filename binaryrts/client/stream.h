@@ -0,0 +1,61 @@
+#ifndef _CLIENT_STREAM_H_
+#define _CLIENT_STREAM_H_
+
+#include "dr_api.h"
+#include "coverage.h"
+
+/*
+ * Streaming of runtime coverage dumps to a local consumer (e.g., the resolver in -stream mode).
+ * Instead of writing N.log files, each dump is sent as a single frame over a FIFO (or named pipe on Windows):
+ *
+ *   stream_frame_header_t | dump prefix (prefix_length bytes) | dump ID (id_length bytes) |
+ *   dump payload (payload_length bytes)
+ *
+ * The payload has exactly the format of a N.log file. The dump prefix (e.g., shard<N>_ of GoogleTest shards) is the
+ * prefix of that file name and of its dump-lookup.log entry, such that dumps of clients that share a log directory
+ * never overwrite each other. Frames are written in native byte order. Frames of different processes may interleave,
+ * hence each process needs its own stream.
+ * Note: The resolver declares the same frame header, both must be kept in sync.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_FRAME_MAGIC 0x53545242 /* "BRTS" */
+#define STREAM_FRAME_VERSION 2
+
+typedef struct _stream_frame_header_t {
+    uint magic;
+    uint version;
+    uint dump_number;      /* The number N that would have been used for the N.log file. */
+    uint prefix_length;    /* Length of the dump prefix, without null terminator. */
+    uint id_length;        /* Length of the dump ID (i.e., the test identifier), without null terminator. */
+    uint reserved;
+    uint64 payload_length; /* Length of the coverage dump. */
+} stream_frame_header_t;
+
+/*
+ * Opens the stream at `path`. For a FIFO, this blocks until the consumer has opened it for reading.
+ */
+covlib_status_t
+stream_init(const char *path);
+
+bool
+stream_enabled(void);
+
+/*
+ * Sends a single dump frame. Returns false if the stream is broken, in which case it is closed.
+ */
+bool
+stream_send_dump(const char *dump_prefix, uint dump_number, const char *dump_id, const char *payload,
+                 size_t payload_length);
+
+void
+stream_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLIENT_STREAM_H_ */
@@ -93,7 +93,8 @@ bool enumerateLinesCb(drsym_line_info_t *info, void *data) {
             "unknown",
             info->file,
             info->line,
-            info->line_addr
+            info->line_addr,
+            0
     };
     if (std::regex_match(sourceLine.file, *enumCtx->sourceFileRegex)) {
         enumCtx->sourceLineOffsetMap->emplace(info->line_addr, sourceLine);
@@ -122,11 +123,12 @@ struct EnumerateSymbolsCtx {
     OffsetMap *const sourceLinesOffsetMap;
 };
 
-bool enumerateSymbolsCb(const char *name, size_t modoffs, void *data) {
+bool enumerateSymbolsCb(drsym_info_t *info, drsym_error_t status, void *data) {
     auto *enumCtx = static_cast<EnumerateSymbolsCtx *>(data);
-    auto it = enumCtx->sourceLinesOffsetMap->find(modoffs);
+    auto it = enumCtx->sourceLinesOffsetMap->find(info->start_offs);
     if (it != enumCtx->sourceLinesOffsetMap->end()) {
-        (*it).second.name = name;
+        (*it).second.name = info->name;
+        (*it).second.end = info->end_offs;
         enumCtx->sourceLines->emplace_back((*it).second);
         enumCtx->sourceLinesOffsetMap->erase(it);
     }
@@ -136,9 +138,12 @@ bool enumerateSymbolsCb(const char *name, size_t modoffs, void *data) {
 SourceLines SourceLineExtractor::filterSourceLinesForSymbols(OffsetMap &sourceLinesOffsetMap) {
     SourceLines lines{};
     EnumerateSymbolsCtx ctx{&lines, &sourceLinesOffsetMap};
-    drsym_error_t symres = drsym_enumerate_symbols(
+    // The extended enumeration also provides the end offsets of symbols, which the resolver uses to map
+    // all offsets of a function (e.g., of basic blocks) to its symbol.
+    drsym_error_t symres = drsym_enumerate_symbols_ex(
             options.file.string().c_str(),
             enumerateSymbolsCb,
+            sizeof(drsym_info_t),
             &ctx,
             DRSYM_DEFAULT_FLAGS
     );
@@ -156,9 +161,13 @@ SourceLineExtractor::writeSourceLinesToOutput(const SourceLines &sourceLines) {
     fs::path outputFile = options.file.parent_path() / (options.file.filename().string() + ".binaryrts");
     FILE *fp = fopen(outputFile.string().c_str(), "w+");
     for (const auto &sourceLine: sourceLines) {
-        fprintf(fp, "0x%zx" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%lu\n",
+        fprintf(fp, "0x%zx" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%lu",
                 sourceLine.offset, sourceLine.file.c_str(), sourceLine.name.c_str(),
                 sourceLine.line);
+        if (sourceLine.end > sourceLine.offset) {
+            fprintf(fp, NON_FILE_PATH_SEP "0x%zx", sourceLine.end);
+        }
+        fprintf(fp, "\n");
     }
     fclose(fp);
 }
\ No newline at end of file
@@ -24,6 +24,7 @@ struct SourceLine {
     std::string file;
     uint64_t line;
     size_t offset;
+    size_t end; // end offset of the symbol (exclusive), 0 if unknown (i.e., for lines)
 };
 
 using SourceLines = std::vector<SourceLine>;
@@ -0,0 +1,463 @@
+#include "filter.h"
+#include <string.h>
+
+/*
+ * Module/image name filter, see filter.h for the pattern syntax.
+ * Only memcpy, memset and strlen are used from libc, which DynamoRIO also provides without libc.
+ */
+
+#define NONE ((unsigned int) -1)
+#define INIT_CAPACITY 16
+/* Markers around the name, such that prefix and suffix patterns are anchored in the automaton. */
+#define BEGIN_MARKER '\x02'
+#define END_MARKER '\x03'
+
+/* Internal data structures. */
+
+typedef struct _filter_node_t {
+    unsigned int first_edge; /* Index into edges, or NONE. */
+    unsigned int fail;       /* Longest proper suffix of this node that is also a node. */
+    int output;              /* Whether a pattern ends here (or in a node of the fail chain). */
+} filter_node_t;
+
+typedef struct _filter_edge_t {
+    unsigned int target;
+    unsigned int next; /* Next edge of the same node, or NONE. */
+    unsigned char label;
+} filter_edge_t;
+
+struct _filter_t {
+    filter_allocator_t allocator;
+    filter_plain_mode_t plain_mode;
+    size_t num_patterns;
+    int compiled;
+
+    /* Exact patterns, open-addressing hash set of owned, null-terminated strings. */
+    char **exact;
+    size_t exact_capacity;
+    size_t num_exact;
+
+    /* Prefix, suffix and substring patterns, Aho-Corasick automaton with sparse transitions. Node 0 is the root. */
+    filter_node_t *nodes;
+    size_t node_capacity;
+    size_t num_nodes;
+    filter_edge_t *edges;
+    size_t edge_capacity;
+    size_t num_edges;
+
+    /* All other globs, owned, null-terminated strings. */
+    char **globs;
+    size_t glob_capacity;
+    size_t num_globs;
+};
+
+/* Helpers. */
+
+static int
+grow_array(filter_t *filter, void **array, size_t *capacity, size_t element_size, size_t needed) {
+    size_t new_capacity;
+    void *grown;
+    if (needed <= *capacity)
+        return 1;
+    new_capacity = *capacity == 0 ? INIT_CAPACITY : *capacity;
+    while (new_capacity < needed)
+        new_capacity *= 2;
+    grown = filter->allocator.alloc(new_capacity * element_size);
+    if (grown == NULL)
+        return 0;
+    if (*array != NULL) {
+        memcpy(grown, *array, *capacity * element_size);
+        filter->allocator.free(*array, *capacity * element_size);
+    }
+    *array = grown;
+    *capacity = new_capacity;
+    return 1;
+}
+
+static char *
+copy_string(filter_t *filter, const char *str, size_t length) {
+    char *copy = (char *) filter->allocator.alloc(length + 1);
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static void
+free_string(filter_t *filter, char *str) {
+    filter->allocator.free(str, strlen(str) + 1);
+}
+
+static int
+equals(const char *str, const char *other, size_t length) {
+    size_t i;
+    for (i = 0; i < length; i++) {
+        if (str[i] != other[i])
+            return 0;
+    }
+    return str[length] == '\0';
+}
+
+static size_t
+hash_string(const char *str, size_t length) {
+    /* FNV-1a */
+    size_t hash = (size_t) 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char) str[i];
+        hash *= (size_t) 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int
+is_wildcard(char c) {
+    return c == '*' || c == '?';
+}
+
+/* Exact patterns. */
+
+static int
+exact_insert_owned(filter_t *filter, char *str) {
+    size_t mask = filter->exact_capacity - 1;
+    size_t length = strlen(str);
+    size_t slot = hash_string(str, length) & mask;
+    while (filter->exact[slot] != NULL) {
+        if (equals(filter->exact[slot], str, length)) {
+            free_string(filter, str);
+            return 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+    filter->exact[slot] = str;
+    filter->num_exact++;
+    return 1;
+}
+
+static int
+exact_add(filter_t *filter, const char *pattern, size_t length) {
+    char *copy;
+    /* Keep the load factor below 1/2. */
+    if ((filter->num_exact + 1) * 2 > filter->exact_capacity) {
+        char **old = filter->exact;
+        size_t old_capacity = filter->exact_capacity;
+        size_t i;
+        size_t capacity = old_capacity == 0 ? INIT_CAPACITY : old_capacity * 2;
+        filter->exact = (char **) filter->allocator.alloc(capacity * sizeof(char *));
+        if (filter->exact == NULL) {
+            filter->exact = old;
+            return 0;
+        }
+        memset(filter->exact, 0, capacity * sizeof(char *));
+        filter->exact_capacity = capacity;
+        filter->num_exact = 0;
+        for (i = 0; i < old_capacity; i++) {
+            if (old[i] != NULL)
+                exact_insert_owned(filter, old[i]);
+        }
+        if (old != NULL)
+            filter->allocator.free(old, old_capacity * sizeof(char *));
+    }
+    copy = copy_string(filter, pattern, length);
+    if (copy == NULL)
+        return 0;
+    return exact_insert_owned(filter, copy);
+}
+
+static int
+exact_contains(const filter_t *filter, const char *name) {
+    size_t mask, length, slot;
+    if (filter->num_exact == 0)
+        return 0;
+    mask = filter->exact_capacity - 1;
+    length = strlen(name);
+    slot = hash_string(name, length) & mask;
+    while (filter->exact[slot] != NULL) {
+        if (equals(filter->exact[slot], name, length))
+            return 1;
+        slot = (slot + 1) & mask;
+    }
+    return 0;
+}
+
+/* Aho-Corasick automaton. */
+
+static unsigned int
+find_edge(const filter_t *filter, unsigned int node, unsigned char label) {
+    unsigned int edge = filter->nodes[node].first_edge;
+    while (edge != NONE) {
+        if (filter->edges[edge].label == label)
+            return filter->edges[edge].target;
+        edge = filter->edges[edge].next;
+    }
+    return NONE;
+}
+
+static unsigned int
+add_node(filter_t *filter) {
+    filter_node_t *node;
+    if (!grow_array(filter, (void **) &filter->nodes, &filter->node_capacity, sizeof(filter_node_t),
+                    filter->num_nodes + 1))
+        return NONE;
+    node = &filter->nodes[filter->num_nodes];
+    node->first_edge = NONE;
+    node->fail = 0;
+    node->output = 0;
+    return (unsigned int) filter->num_nodes++;
+}
+
+static unsigned int
+add_child(filter_t *filter, unsigned int node, unsigned char label) {
+    unsigned int child = find_edge(filter, node, label);
+    filter_edge_t *edge;
+    if (child != NONE)
+        return child;
+    child = add_node(filter);
+    if (child == NONE ||
+        !grow_array(filter, (void **) &filter->edges, &filter->edge_capacity, sizeof(filter_edge_t),
+                    filter->num_edges + 1))
+        return NONE;
+    edge = &filter->edges[filter->num_edges];
+    edge->target = child;
+    edge->label = label;
+    edge->next = filter->nodes[node].first_edge;
+    filter->nodes[node].first_edge = (unsigned int) filter->num_edges++;
+    return child;
+}
+
+static int
+automaton_add(filter_t *filter, const char *core, size_t length, int anchor_begin, int anchor_end) {
+    unsigned int node = 0;
+    size_t i;
+    if (filter->num_nodes == 0 && add_node(filter) == NONE)
+        return 0;
+    if (anchor_begin)
+        node = add_child(filter, node, BEGIN_MARKER);
+    for (i = 0; i < length && node != NONE; i++)
+        node = add_child(filter, node, (unsigned char) core[i]);
+    if (anchor_end && node != NONE)
+        node = add_child(filter, node, END_MARKER);
+    if (node == NONE)
+        return 0;
+    filter->nodes[node].output = 1;
+    return 1;
+}
+
+static unsigned int
+automaton_step(const filter_t *filter, unsigned int state, unsigned char c) {
+    for (;;) {
+        unsigned int next = find_edge(filter, state, c);
+        if (next != NONE)
+            return next;
+        if (state == 0)
+            return 0;
+        state = filter->nodes[state].fail;
+    }
+}
+
+static int
+automaton_compile(filter_t *filter) {
+    unsigned int *queue;
+    size_t head = 0, tail = 0;
+    unsigned int edge;
+    if (filter->num_nodes == 0)
+        return 1;
+    queue = (unsigned int *) filter->allocator.alloc(filter->num_nodes * sizeof(unsigned int));
+    if (queue == NULL)
+        return 0;
+
+    /* Breadth-first, such that the fail links of shallower nodes are known. */
+    for (edge = filter->nodes[0].first_edge; edge != NONE; edge = filter->edges[edge].next) {
+        filter->nodes[filter->edges[edge].target].fail = 0;
+        queue[tail++] = filter->edges[edge].target;
+    }
+    while (head < tail) {
+        unsigned int node = queue[head++];
+        for (edge = filter->nodes[node].first_edge; edge != NONE; edge = filter->edges[edge].next) {
+            unsigned int child = filter->edges[edge].target;
+            unsigned char label = filter->edges[edge].label;
+            unsigned int fail = filter->nodes[node].fail;
+            unsigned int target;
+            while (fail != 0 && find_edge(filter, fail, label) == NONE)
+                fail = filter->nodes[fail].fail;
+            target = find_edge(filter, fail, label);
+            filter->nodes[child].fail = target != NONE && target != child ? target : 0;
+            filter->nodes[child].output |= filter->nodes[filter->nodes[child].fail].output;
+            queue[tail++] = child;
+        }
+    }
+    filter->allocator.free(queue, filter->num_nodes * sizeof(unsigned int));
+    return 1;
+}
+
+static int
+automaton_matches(const filter_t *filter, const char *name) {
+    unsigned int state;
+    const char *c;
+    if (filter->num_nodes == 0)
+        return 0;
+    if (filter->nodes[0].output)
+        return 1;
+    state = automaton_step(filter, 0, BEGIN_MARKER);
+    if (filter->nodes[state].output)
+        return 1;
+    for (c = name; *c != '\0'; c++) {
+        state = automaton_step(filter, state, (unsigned char) *c);
+        if (filter->nodes[state].output)
+            return 1;
+    }
+    state = automaton_step(filter, state, END_MARKER);
+    return filter->nodes[state].output;
+}
+
+/* Globs. */
+
+static int
+glob_matches(const char *glob, const char *name) {
+    const char *star = NULL;
+    const char *resume = NULL;
+    while (*name != '\0') {
+        if (*glob == '*') {
+            star = glob++;
+            resume = name;
+        } else if (*glob == '?' || *glob == *name) {
+            glob++;
+            name++;
+        } else if (star != NULL) {
+            /* Let the last star consume one more character. */
+            glob = star + 1;
+            name = ++resume;
+        } else {
+            return 0;
+        }
+    }
+    while (*glob == '*')
+        glob++;
+    return *glob == '\0';
+}
+
+/* Library interface. */
+
+filter_t *
+filter_create(const filter_allocator_t *allocator, filter_plain_mode_t plain_mode) {
+    filter_t *filter = (filter_t *) allocator->alloc(sizeof(filter_t));
+    if (filter == NULL)
+        return NULL;
+    memset(filter, 0, sizeof(*filter));
+    filter->allocator = *allocator;
+    filter->plain_mode = plain_mode;
+    return filter;
+}
+
+void
+filter_destroy(filter_t *filter) {
+    size_t i;
+    if (filter == NULL)
+        return;
+    for (i = 0; i < filter->exact_capacity; i++) {
+        if (filter->exact[i] != NULL)
+            free_string(filter, filter->exact[i]);
+    }
+    if (filter->exact != NULL)
+        filter->allocator.free(filter->exact, filter->exact_capacity * sizeof(char *));
+    if (filter->nodes != NULL)
+        filter->allocator.free(filter->nodes, filter->node_capacity * sizeof(filter_node_t));
+    if (filter->edges != NULL)
+        filter->allocator.free(filter->edges, filter->edge_capacity * sizeof(filter_edge_t));
+    for (i = 0; i < filter->num_globs; i++)
+        free_string(filter, filter->globs[i]);
+    if (filter->globs != NULL)
+        filter->allocator.free(filter->globs, filter->glob_capacity * sizeof(char *));
+    filter->allocator.free(filter, sizeof(filter_t));
+}
+
+int
+filter_add(filter_t *filter, const char *pattern, size_t length) {
+    const char *core = pattern;
+    size_t core_length = length;
+    int leading_star, trailing_star;
+    size_t i;
+
+    filter->compiled = 0;
+    filter->num_patterns++;
+
+    leading_star = length > 0 && pattern[0] == '*';
+    trailing_star = length > 0 && pattern[length - 1] == '*';
+    if (leading_star) {
+        core++;
+        core_length--;
+    }
+    if (trailing_star && core_length > 0)
+        core_length--;
+
+    for (i = 0; i < core_length; i++) {
+        if (is_wildcard(core[i])) {
+            /* Wildcards within the pattern, fall back to the glob matcher. */
+            char *copy;
+            if (!grow_array(filter, (void **) &filter->globs, &filter->glob_capacity, sizeof(char *),
+                            filter->num_globs + 1))
+                return 0;
+            copy = copy_string(filter, pattern, length);
+            if (copy == NULL)
+                return 0;
+            filter->globs[filter->num_globs++] = copy;
+            return 1;
+        }
+    }
+
+    if (!leading_star && !trailing_star) {
+        if (filter->plain_mode == FILTER_PLAIN_EXACT)
+            return exact_add(filter, core, core_length);
+        return automaton_add(filter, core, core_length, 0, 0);
+    }
+    return automaton_add(filter, core, core_length, !leading_star, !trailing_star);
+}
+
+int
+filter_add_list(filter_t *filter, const char *list, char separator) {
+    const char *start = list;
+    for (;;) {
+        const char *end = start;
+        const char *next;
+        while (*end != '\0' && *end != separator)
+            end++;
+        next = end;
+        while (start < end && (*start == ' ' || *start == '\t' || *start == '\r' || *start == '\n'))
+            start++;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+            end--;
+        if (end > start && !filter_add(filter, start, (size_t) (end - start)))
+            return 0;
+        if (*next == '\0')
+            return 1;
+        start = next + 1;
+    }
+}
+
+int
+filter_compile(filter_t *filter) {
+    if (!automaton_compile(filter))
+        return 0;
+    filter->compiled = 1;
+    return 1;
+}
+
+int
+filter_matches(const filter_t *filter, const char *name) {
+    size_t i;
+    if (filter == NULL || !filter->compiled)
+        return 0;
+    if (exact_contains(filter, name) || automaton_matches(filter, name))
+        return 1;
+    for (i = 0; i < filter->num_globs; i++) {
+        if (glob_matches(filter->globs[i], name))
+            return 1;
+    }
+    return 0;
+}
+
+size_t
+filter_size(const filter_t *filter) {
+    return filter == NULL ? 0 : filter->num_patterns;
+}
@@ -0,0 +1,80 @@
+#ifndef _BINARYRTS_FILTER_H_
+#define _BINARYRTS_FILTER_H_
+
+#include <stddef.h>
+
+/*
+ * Module/image name filter shared by the BinaryRTS DynamoRIO client and the Pin tool.
+ *
+ * Patterns use glob syntax (`*` matches any sequence, `?` a single character) and are compiled once:
+ *   - `name`           exact match (or substring, see filter_plain_mode_t), stored in a hash set
+ *   - `prefix*`, `*suffix`, `*substring*`
+ *                      matched in a single pass by an Aho-Corasick automaton, in which prefixes and
+ *                      suffixes are anchored to begin and end markers around the name
+ *   - anything else    (e.g., `lib*-test?.so`) matched by a backtracking glob matcher
+ *
+ * The filter does not use libc allocation, memory is requested through the given allocator, such that
+ * it can be used in DynamoRIO clients without libc. The code compiles as C and C++.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _filter_allocator_t {
+    void *(*alloc)(size_t size);
+    void (*free)(void *ptr, size_t size);
+} filter_allocator_t;
+
+typedef enum {
+    FILTER_PLAIN_EXACT,     /* Patterns without wildcards must match the whole name. */
+    FILTER_PLAIN_SUBSTRING, /* Patterns without wildcards match anywhere in the name (as `*pattern*`). */
+} filter_plain_mode_t;
+
+typedef struct _filter_t filter_t;
+
+/*
+ * Creates an empty filter, returns NULL if out of memory. The allocator is copied.
+ */
+filter_t *
+filter_create(const filter_allocator_t *allocator, filter_plain_mode_t plain_mode);
+
+void
+filter_destroy(filter_t *filter);
+
+/*
+ * Adds a single pattern of `length` characters. Returns 0 if out of memory.
+ */
+int
+filter_add(filter_t *filter, const char *pattern, size_t length);
+
+/*
+ * Adds all patterns of a `separator`-separated list, whitespace around patterns and empty patterns are
+ * skipped. Returns 0 if out of memory.
+ */
+int
+filter_add_list(filter_t *filter, const char *list, char separator);
+
+/*
+ * Compiles the patterns added so far, must be called before filter_matches. Returns 0 if out of memory.
+ */
+int
+filter_compile(filter_t *filter);
+
+/*
+ * Returns 1 if `name` matches any pattern of the (compiled) filter. Thread-safe.
+ */
+int
+filter_matches(const filter_t *filter, const char *name);
+
+/*
+ * Returns the number of patterns in the filter.
+ */
+size_t
+filter_size(const filter_t *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BINARYRTS_FILTER_H_ */
@@ -0,0 +1,142 @@
+/*
+ * Benchmark of the module/image name filter: compares compiled filters against matching every
+ * pattern one after the other (as the Pin tool and DynamoRIO client did before), and checks that
+ * both agree.
+ *
+ * Usage: binary_rts_filter_bench [num_patterns] [num_images] [rounds]
+ */
+
+#include "filter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_NAME 64
+
+static void *
+bench_alloc(size_t size) {
+    return malloc(size);
+}
+
+static void
+bench_free(void *ptr, size_t size) {
+    (void) size;
+    free(ptr);
+}
+
+static double
+now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Reference implementation: recursive glob matching of a single pattern. */
+static int
+naive_glob(const char *glob, const char *name) {
+    if (*glob == '\0')
+        return *name == '\0';
+    if (*glob == '*')
+        return naive_glob(glob + 1, name) || (*name != '\0' && naive_glob(glob, name + 1));
+    if (*name != '\0' && (*glob == '?' || *glob == *name))
+        return naive_glob(glob + 1, name + 1);
+    return 0;
+}
+
+static int
+naive_matches(char patterns[][MAX_NAME], int num_patterns, const char *name) {
+    int i;
+    for (i = 0; i < num_patterns; i++) {
+        if (naive_glob(patterns[i], name))
+            return 1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv) {
+    int num_patterns = argc > 1 ? atoi(argv[1]) : 5000;
+    int num_images = argc > 2 ? atoi(argv[2]) : 5000;
+    int rounds = argc > 3 ? atoi(argv[3]) : 10;
+    char (*patterns)[MAX_NAME] = malloc((size_t) num_patterns * MAX_NAME);
+    char (*images)[MAX_NAME] = malloc((size_t) num_images * MAX_NAME);
+    filter_allocator_t allocator = { bench_alloc, bench_free };
+    filter_t *filter = filter_create(&allocator, FILTER_PLAIN_EXACT);
+    double start, compile_ms, filter_ms, naive_ms;
+    int i, round, filter_hits = 0, naive_hits = 0, mismatches = 0;
+
+    if (patterns == NULL || images == NULL || filter == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    /* Mix of all pattern kinds, roughly half of the images match. */
+    srand(42);
+    for (i = 0; i < num_patterns; i++) {
+        switch (i % 5) {
+        case 0: snprintf(patterns[i], MAX_NAME, "libmod%05d.so", i); break;
+        case 1: snprintf(patterns[i], MAX_NAME, "libpre%05d*", i); break;
+        case 2: snprintf(patterns[i], MAX_NAME, "*-suf%05d.so", i); break;
+        case 3: snprintf(patterns[i], MAX_NAME, "*sub%05d*", i); break;
+        default: snprintf(patterns[i], MAX_NAME, "lib?glob%05d*.so", i); break;
+        }
+    }
+    for (i = 0; i < num_images; i++) {
+        int n = rand() % (num_patterns * 2);
+        switch (rand() % 5) {
+        case 0: snprintf(images[i], MAX_NAME, "libmod%05d.so", n); break;
+        case 1: snprintf(images[i], MAX_NAME, "libpre%05d.so.1", n); break;
+        case 2: snprintf(images[i], MAX_NAME, "libfoo-suf%05d.so", n); break;
+        case 3: snprintf(images[i], MAX_NAME, "libxsub%05dy.so", n); break;
+        default: snprintf(images[i], MAX_NAME, "libXglob%05d-v2.so", n); break;
+        }
+    }
+
+    start = now_ms();
+    for (i = 0; i < num_patterns; i++) {
+        if (!filter_add(filter, patterns[i], strlen(patterns[i]))) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+    if (!filter_compile(filter)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    compile_ms = now_ms() - start;
+
+    start = now_ms();
+    for (round = 0; round < rounds; round++) {
+        for (i = 0; i < num_images; i++)
+            filter_hits += filter_matches(filter, images[i]);
+    }
+    filter_ms = now_ms() - start;
+
+    start = now_ms();
+    for (round = 0; round < rounds; round++) {
+        for (i = 0; i < num_images; i++)
+            naive_hits += naive_matches(patterns, num_patterns, images[i]);
+    }
+    naive_ms = now_ms() - start;
+
+    for (i = 0; i < num_images; i++) {
+        if (filter_matches(filter, images[i]) != naive_matches(patterns, num_patterns, images[i])) {
+            if (mismatches++ < 10)
+                fprintf(stderr, "Mismatch for %s\n", images[i]);
+        }
+    }
+
+    printf("patterns: %d, images: %d, rounds: %d, matches per round: %d\n", num_patterns, num_images, rounds,
+           filter_hits / (rounds > 0 ? rounds : 1));
+    printf("compile:  %10.3f ms\n", compile_ms);
+    printf("filter:   %10.3f ms (%.3f us per image)\n", filter_ms,
+           filter_ms * 1000.0 / ((double) num_images * rounds));
+    printf("naive:    %10.3f ms (%.3f us per image)\n", naive_ms,
+           naive_ms * 1000.0 / ((double) num_images * rounds));
+
+    filter_destroy(filter);
+    free(patterns);
+    free(images);
+    return mismatches == 0 && filter_hits == naive_hits ? 0 : 1;
+}
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "generator.h"
+
+namespace {
+    const char *TEST_MODULE = "synthetic_tests";
+    const char *TEST_ID_SEP = "!!!";
+    const char *EXPECTED_AFFECTED_FILE = "expected-affected.txt";
+
+    // Deterministic constants for generated code (splitmix64).
+    uint64_t
+    mix(uint64_t value) {
+        value += 0x9e3779b97f4a7c15ULL;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    uint32_t
+    constant(uint32_t seed, size_t function, size_t statement) {
+        return static_cast<uint32_t>(mix((static_cast<uint64_t>(seed) << 48) ^ (function << 16) ^ statement));
+    }
+}
+
+void
+ProjectGenerator::generate() {
+    using std::chrono::high_resolution_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+
+    auto before = high_resolution_clock::now();
+    planTests();
+    planChanges();
+    writeProject();
+    writeExpectedAffectedTests();
+    auto after = high_resolution_clock::now();
+
+    printf("INFO: Generated %zu libraries with %zu functions, %zu tests, and %zu changed functions in %lldms "
+           "(%zu files written, %zu unchanged)\n",
+           options.libraries, options.libraries * options.functions, options.tests, changedFunctions.size(),
+           static_cast<long long>(duration_cast<milliseconds>(after - before).count()), filesWritten,
+           filesUnchanged);
+}
+
+void
+ProjectGenerator::planTests() {
+    const size_t numFunctions = options.libraries * options.functions;
+    std::mt19937 rng(options.seed);
+
+    std::vector<size_t> functions(numFunctions);
+    for (size_t i = 0; i < numFunctions; i++) {
+        functions[i] = i;
+    }
+    std::shuffle(functions.begin(), functions.end(), rng);
+    const size_t numHot = std::min(options.hotFunctions, numFunctions);
+    const std::vector<size_t> hot(functions.begin(), functions.begin() + static_cast<ptrdiff_t>(numHot));
+    const std::vector<size_t> cold(functions.begin() + static_cast<ptrdiff_t>(numHot), functions.end());
+
+    const size_t hotCalls = hot.empty() ? 0 : static_cast<size_t>(static_cast<double>(options.calls) * options.overlap + 0.5);
+    const size_t coldCalls = cold.empty() ? 0 : options.calls - std::min(hotCalls, options.calls);
+    std::uniform_int_distribution<size_t> hotDistribution(0, hot.empty() ? 0 : hot.size() - 1);
+
+    testCalls.assign(options.tests, {});
+    size_t nextCold = 0;
+    for (auto &calls: testCalls) {
+        calls.reserve(hotCalls + coldCalls);
+        for (size_t i = 0; i < hotCalls && !hot.empty(); i++) {
+            size_t function = hot[hotDistribution(rng)];
+            calls.push_back({function / options.functions, function % options.functions});
+        }
+        for (size_t i = 0; i < coldCalls; i++) {
+            size_t function = cold[nextCold++ % cold.size()];
+            calls.push_back({function / options.functions, function % options.functions});
+        }
+    }
+}
+
+void
+ProjectGenerator::planChanges() {
+    const size_t numFunctions = options.libraries * options.functions;
+    // Separate generator, such that the planned tests do not depend on the number of changes.
+    std::mt19937 rng(options.seed + 1);
+    std::uniform_int_distribution<size_t> distribution(0, numFunctions - 1);
+    while (changedFunctions.size() < std::min(options.changes, numFunctions)) {
+        changedFunctions.insert(distribution(rng));
+    }
+}
+
+std::string
+ProjectGenerator::functionName(const FunctionRef &function) const {
+    return "lib" + std::to_string(function.library) + "_f" + std::to_string(function.function);
+}
+
+std::string
+ProjectGenerator::functionBody(const FunctionRef &function) const {
+    const size_t index = globalIndex(function);
+    const uint32_t version = changedFunctions.count(index) > 0 ? 1 : 0;
+    std::ostringstream body;
+    body << "int " << functionName(function) << "(int x) {\n"
+         << "    unsigned int y = static_cast<unsigned int>(x) + " << constant(options.seed, index, 0) + version
+         << "u;\n";
+    for (size_t i = 1; i <= options.statements; i++) {
+        if (i % 4 == 0) {
+            body << "    if (y & " << (1u << (i % 5)) << "u) {\n"
+                 << "        y += " << constant(options.seed, index, i) << "u;\n"
+                 << "    }\n";
+        } else {
+            body << "    y = (y ^ (y >> " << 1 + i % 7 << ")) * " << (constant(options.seed, index, i) | 1u) << "u + "
+                 << i << "u;\n";
+        }
+    }
+    body << "    return static_cast<int>(y);\n"
+         << "}\n";
+    return body.str();
+}
+
+void
+ProjectGenerator::writeFile(const fs::path &path, const std::string &content) {
+    fs::path file = options.output / path;
+    {
+        std::ifstream existing(file, std::ios::binary);
+        if (existing) {
+            std::ostringstream existingContent;
+            existingContent << existing.rdbuf();
+            if (existingContent.str() == content) {
+                filesUnchanged++;
+                return;
+            }
+        }
+    }
+    fs::create_directories(file.parent_path());
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Failed to write " + file.string());
+    }
+    out << content;
+    filesWritten++;
+    if (options.debug)
+        printf("DEBUG: Wrote %s\n", file.string().c_str());
+}
+
+void
+ProjectGenerator::writeProject() {
+    std::ostringstream cmake;
+    cmake << "# Generated by binary_rts_generator, do not edit.\n"
+          << "cmake_minimum_required(VERSION 3.15)\n\n"
+          << "project(SyntheticProject CXX)\n\n"
+          << "set(CMAKE_CXX_STANDARD 14)\n"
+          << "# Keep executables and shared libraries in one directory, and export all functions on Windows.\n"
+          << "set(CMAKE_RUNTIME_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/bin)\n"
+          << "set(CMAKE_LIBRARY_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/bin)\n"
+          << "set(CMAKE_WINDOWS_EXPORT_ALL_SYMBOLS ON)\n\n"
+          << "option(SYNTHETIC_SHARED_LIBS \"Build each library as shared library (i.e., a separate module)\" ON)\n"
+          << "set(BINARY_RTS_ROOT \"\" CACHE PATH \"BinaryRTS repository, enables the BinaryRTS test listener\")\n\n"
+          << "if (SYNTHETIC_SHARED_LIBS)\n"
+          << "    set(SYNTHETIC_LIBRARY_TYPE SHARED)\n"
+          << "else ()\n"
+          << "    set(SYNTHETIC_LIBRARY_TYPE STATIC)\n"
+          << "endif ()\n\n"
+          << "if (BINARY_RTS_ROOT)\n"
+          << "    include(${BINARY_RTS_ROOT}/cmake/GoogleTest.cmake)\n"
+          << "    add_subdirectory(${BINARY_RTS_ROOT}/binaryrts/listener binaryrts_listener)\n"
+          << "    set(SYNTHETIC_TEST_LIBS gtest binary_rts_listener)\n"
+          << "else ()\n"
+          << "    find_package(GTest REQUIRED)\n"
+          << "    set(SYNTHETIC_TEST_LIBS GTest::gtest)\n"
+          << "endif ()\n\n";
+    for (size_t library = 0; library < options.libraries; library++) {
+        cmake << "add_subdirectory(lib" << library << ")\n";
+        writeLibrary(library);
+    }
+    cmake << "add_subdirectory(tests)\n";
+    writeFile("CMakeLists.txt", cmake.str());
+
+    const size_t numSuites = (options.tests + options.testsPerSuite - 1) / options.testsPerSuite;
+    std::ostringstream tests;
+    tests << "# Generated by binary_rts_generator, do not edit.\n"
+          << "add_executable(" << TEST_MODULE << "\n"
+          << "        main.cpp\n";
+    for (size_t suite = 0; suite < numSuites; suite++) {
+        tests << "        suite" << suite << ".cpp\n";
+        writeSuite(suite);
+    }
+    tests << ")\n"
+          << "target_link_libraries(" << TEST_MODULE << " ${SYNTHETIC_TEST_LIBS}";
+    for (size_t library = 0; library < options.libraries; library++) {
+        tests << " synth_lib" << library;
+    }
+    tests << ")\n"
+          << "if (BINARY_RTS_ROOT)\n"
+          << "    target_compile_definitions(" << TEST_MODULE << " PRIVATE TEST_LISTENER)\n"
+          << "endif ()\n";
+    writeFile(fs::path("tests") / "CMakeLists.txt", tests.str());
+
+    writeFile(fs::path("tests") / "synthetic.h",
+              "#pragma once\n\n"
+              "// Keeps the compiler from dropping the calls of a test.\n"
+              "void consume(int value);\n");
+    writeFile(fs::path("tests") / "main.cpp",
+              "#include <gtest/gtest.h>\n\n"
+              "#include \"synthetic.h\"\n\n"
+              "#ifdef TEST_LISTENER\n"
+              "#include \"test_listener.h\"\n\n"
+              "class CoverageEventListener : public testing::EmptyTestEventListener {\n"
+              "public:\n"
+              "    void OnTestProgramStart(const testing::UnitTest &test) override {\n"
+              "        BinaryRTSTestListener::TestProgramStart();\n"
+              "    }\n\n"
+              "    void OnTestSuiteStart(const testing::TestSuite &testSuite) override {\n"
+              "        BinaryRTSTestListener::TestSuiteStart(testSuite.name());\n"
+              "    }\n\n"
+              "    void OnTestStart(const testing::TestInfo &testInfo) override {\n"
+              "        BinaryRTSTestListener::TestStart(testInfo.name());\n"
+              "    }\n\n"
+              "    void OnTestEnd(const testing::TestInfo &testInfo) override {\n"
+              "        BinaryRTSTestListener::TestEnd(testInfo.result()->Passed() ? \"PASSED\" : \"FAILED\");\n"
+              "    }\n\n"
+              "    void OnTestSuiteEnd(const testing::TestSuite &testSuite) override {\n"
+              "        BinaryRTSTestListener::TestSuiteEnd(testSuite.Passed() ? \"PASSED\" : \"FAILED\");\n"
+              "    }\n\n"
+              "    void OnTestProgramEnd(const testing::UnitTest &test) override {\n"
+              "        BinaryRTSTestListener::TestProgramEnd();\n"
+              "    }\n"
+              "};\n"
+              "#endif\n\n"
+              "namespace {\n"
+              "    volatile int sink;\n"
+              "}\n\n"
+              "void consume(int value) {\n"
+              "    sink = value;\n"
+              "}\n\n"
+              "int main(int argc, char **argv) {\n"
+              "    ::testing::InitGoogleTest(&argc, argv);\n"
+              "#ifdef TEST_LISTENER\n"
+              "    ::testing::UnitTest::GetInstance()->listeners().Append(new CoverageEventListener());\n"
+              "#endif\n"
+              "    return RUN_ALL_TESTS();\n"
+              "}\n");
+}
+
+void
+ProjectGenerator::writeLibrary(size_t library) {
+    const std::string name = "lib" + std::to_string(library);
+    const fs::path dir(name);
+    const size_t numFiles = (options.functions + options.functionsPerFile - 1) / options.functionsPerFile;
+
+    std::ostringstream header;
+    header << "#pragma once\n\n";
+    for (size_t function = 0; function < options.functions; function++) {
+        header << "int " << functionName({library, function}) << "(int x);\n";
+    }
+    writeFile(dir / "include" / (name + ".h"), header.str());
+
+    std::ostringstream cmake;
+    cmake << "# Generated by binary_rts_generator, do not edit.\n"
+          << "add_library(synth_" << name << " ${SYNTHETIC_LIBRARY_TYPE}\n";
+    for (size_t file = 0; file < numFiles; file++) {
+        const std::string fileName = name + "_" + std::to_string(file) + ".cpp";
+        cmake << "        src/" << fileName << "\n";
+
+        std::ostringstream source;
+        source << "#include \"" << name << ".h\"\n";
+        const size_t end = std::min(options.functions, (file + 1) * options.functionsPerFile);
+        for (size_t function = file * options.functionsPerFile; function < end; function++) {
+            source << "\n" << functionBody({library, function});
+        }
+        writeFile(dir / "src" / fileName, source.str());
+    }
+    cmake << ")\n"
+          << "target_include_directories(synth_" << name << " PUBLIC ${CMAKE_CURRENT_SOURCE_DIR}/include)\n";
+    writeFile(dir / "CMakeLists.txt", cmake.str());
+}
+
+void
+ProjectGenerator::writeSuite(size_t suite) {
+    const size_t begin = suite * options.testsPerSuite;
+    const size_t end = std::min(options.tests, begin + options.testsPerSuite);
+
+    std::set<size_t> libraries;
+    for (size_t test = begin; test < end; test++) {
+        for (const auto &call: testCalls[test]) {
+            libraries.insert(call.library);
+        }
+    }
+
+    std::ostringstream source;
+    source << "#include <gtest/gtest.h>\n\n"
+           << "#include \"synthetic.h\"\n";
+    for (size_t library: libraries) {
+        source << "#include \"lib" << library << ".h\"\n";
+    }
+    for (size_t test = begin; test < end; test++) {
+        source << "\nTEST(Suite" << suite << ", Test" << test << ") {\n"
+               << "    int x = " << test << ";\n";
+        for (const auto &call: testCalls[test]) {
+            source << "    x = " << functionName(call) << "(x);\n";
+        }
+        source << "    consume(x);\n"
+               << "}\n";
+    }
+    writeFile(fs::path("tests") / ("suite" + std::to_string(suite) + ".cpp"), source.str());
+}
+
+void
+ProjectGenerator::writeExpectedAffectedTests() {
+    std::ostringstream affected;
+    for (size_t test = 0; test < options.tests; test++) {
+        for (const auto &call: testCalls[test]) {
+            if (changedFunctions.count(globalIndex(call)) > 0) {
+                affected << TEST_MODULE << TEST_ID_SEP << "Suite" << test / options.testsPerSuite << TEST_ID_SEP
+                         << "Test" << test << "\n";
+                break;
+            }
+        }
+    }
+    writeFile(EXPECTED_AFFECTED_FILE, affected.str());
+}
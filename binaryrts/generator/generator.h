@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct GeneratorOptions {
+    fs::path output;
+    size_t libraries;
+    size_t functions;         // per library
+    size_t functionsPerFile;
+    size_t statements;        // per function, scales the binary size
+    size_t tests;
+    size_t testsPerSuite;
+    size_t calls;             // per test
+    size_t hotFunctions;      // shared by all tests
+    double overlap;           // fraction of the calls of each test that go to hot functions
+    size_t changes;           // functions to change with respect to the base version
+    uint32_t seed;
+    bool debug;
+};
+
+/*
+ * Generates a synthetic GoogleTest project with `libraries` libraries of `functions` functions each, and `tests`
+ * test cases that call `calls` functions each. A fraction `overlap` of the calls of each test goes to a set of
+ * `hotFunctions` functions shared by all tests, the remaining calls go to functions that are assigned round-robin to
+ * tests (hence, tests only share them if `tests * calls` exceeds the number of functions).
+ *
+ * The project is fully determined by the options; with `changes > 0`, the same project is generated with the bodies
+ * of `changes` functions changed, and the tests that call them are written to `expected-affected.txt`.
+ * Files are only rewritten if their content changes, such that regenerating with changes yields a minimal diff.
+ */
+class ProjectGenerator {
+public:
+    explicit ProjectGenerator(const GeneratorOptions &options) : options{options} {
+    }
+
+    void generate();
+
+private:
+    struct FunctionRef {
+        size_t library;
+        size_t function;
+    };
+
+    void planTests();
+
+    void planChanges();
+
+    void writeProject();
+
+    void writeLibrary(size_t library);
+
+    void writeSuite(size_t suite);
+
+    void writeExpectedAffectedTests();
+
+    std::string functionName(const FunctionRef &function) const;
+
+    std::string functionBody(const FunctionRef &function) const;
+
+    size_t globalIndex(const FunctionRef &function) const {
+        return function.library * options.functions + function.function;
+    }
+
+    void writeFile(const fs::path &path, const std::string &content);
+
+    const GeneratorOptions options;
+    std::vector<std::vector<FunctionRef>> testCalls;
+    std::unordered_set<size_t> changedFunctions;
+    size_t filesWritten = 0;
+    size_t filesUnchanged = 0;
+};
@@ -0,0 +1,124 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "generator.h"
+
+
+namespace {
+    GeneratorOptions
+    parseArgs(int argc, const char *argv[]) {
+        GeneratorOptions opts;
+        opts.libraries = 10;
+        opts.functions = 1000;
+        opts.functionsPerFile = 100;
+        opts.statements = 8;
+        opts.tests = 1000;
+        opts.testsPerSuite = 100;
+        opts.calls = 20;
+        opts.hotFunctions = 50;
+        opts.overlap = 0.2;
+        opts.changes = 0;
+        opts.seed = 42;
+        opts.debug = false;
+
+        std::string token;
+        bool foundOutput = false;
+
+        for (int i = 1; i < argc; i++) {
+            token = argv[i];
+            if (token == "-output") {
+                assert(("Missing output directory", (i + 1) < argc));
+                opts.output = argv[++i];
+                foundOutput = true;
+            } else if (token == "-libraries") {
+                assert(("Missing number of libraries", (i + 1) < argc));
+                opts.libraries = std::stoul(argv[++i]);
+            } else if (token == "-functions") {
+                assert(("Missing number of functions", (i + 1) < argc));
+                opts.functions = std::stoul(argv[++i]);
+            } else if (token == "-functions_per_file") {
+                assert(("Missing number of functions per file", (i + 1) < argc));
+                opts.functionsPerFile = std::stoul(argv[++i]);
+            } else if (token == "-statements") {
+                assert(("Missing number of statements", (i + 1) < argc));
+                opts.statements = std::stoul(argv[++i]);
+            } else if (token == "-tests") {
+                assert(("Missing number of tests", (i + 1) < argc));
+                opts.tests = std::stoul(argv[++i]);
+            } else if (token == "-tests_per_suite") {
+                assert(("Missing number of tests per suite", (i + 1) < argc));
+                opts.testsPerSuite = std::stoul(argv[++i]);
+            } else if (token == "-calls") {
+                assert(("Missing number of calls", (i + 1) < argc));
+                opts.calls = std::stoul(argv[++i]);
+            } else if (token == "-hot") {
+                assert(("Missing number of hot functions", (i + 1) < argc));
+                opts.hotFunctions = std::stoul(argv[++i]);
+            } else if (token == "-overlap") {
+                assert(("Missing overlap", (i + 1) < argc));
+                opts.overlap = std::stod(argv[++i]);
+            } else if (token == "-changes") {
+                assert(("Missing number of changes", (i + 1) < argc));
+                opts.changes = std::stoul(argv[++i]);
+            } else if (token == "-seed") {
+                assert(("Missing seed", (i + 1) < argc));
+                opts.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (token == "-debug") {
+                opts.debug = true;
+            }
+        }
+        if (!foundOutput) {
+            std::cerr << "Missing output directory." << std::endl;
+            exit(1);
+        }
+        if (opts.libraries == 0 || opts.functions == 0 || opts.functionsPerFile == 0 || opts.testsPerSuite == 0) {
+            std::cerr << "Libraries, functions, functions per file and tests per suite must be positive." << std::endl;
+            exit(1);
+        }
+        if (opts.overlap < 0.0 || opts.overlap > 1.0) {
+            std::cerr << "Overlap must be in [0, 1]." << std::endl;
+            exit(1);
+        }
+        return opts;
+    }
+}
+
+
+/**
+ * The BinaryRTS generator writes a synthetic GoogleTest project of configurable size, to benchmark
+ * collection, symbol resolution and test selection at scale (see README.md).
+ */
+int
+main(int argc, const char *argv[]) {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    try {
+        GeneratorOptions opts = parseArgs(argc, argv);
+        std::cout
+                << "Called BinaryRTS generator with options:\n"
+                << "-output: " << opts.output << "\n"
+                << "-libraries: " << opts.libraries << "\n"
+                << "-functions: " << opts.functions << "\n"
+                << "-functions_per_file: " << opts.functionsPerFile << "\n"
+                << "-statements: " << opts.statements << "\n"
+                << "-tests: " << opts.tests << "\n"
+                << "-tests_per_suite: " << opts.testsPerSuite << "\n"
+                << "-calls: " << opts.calls << "\n"
+                << "-hot: " << opts.hotFunctions << "\n"
+                << "-overlap: " << opts.overlap << "\n"
+                << "-changes: " << opts.changes << "\n"
+                << "-seed: " << opts.seed << std::endl;
+        ProjectGenerator generator{opts};
+        generator.generate();
+    }
+    catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    catch (...) {
+        std::cerr << "Caught unknown exception." << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+"""
+This script generates a synthetic project with `binary_rts_generator` and runs the BinaryRTS pipeline on it:
+build, coverage collection with the DynamoRIO client, symbol resolution with `binary_rts_resolver`, conversion to
+test traces and test selection with the CLI. The wall time and peak memory (RSS) of each stage are written as JSON,
+together with the precision and recall of the selection with respect to the tests that call changed functions.
+Run it with increasing sizes (e.g., `--tests 1000`, `10000`, ...) to obtain a scaling curve of each component.
+"""
+import argparse
+import json
+import os
+import platform
+import re
+import shutil
+import subprocess
+import sys
+import time
+from pathlib import Path
+from typing import Dict, List, Optional, Set
+
+TEST_MODULE: str = "synthetic_tests"
+EXPECTED_AFFECTED_FILE: str = "expected-affected.txt"
+INCLUDED_TESTS_FILE: str = "included.txt"
+
+# Generator options and their defaults (see binary_rts_generator).
+GENERATOR_OPTIONS: Dict[str, object] = {
+    "libraries": 10,
+    "functions": 1000,
+    "functions_per_file": 100,
+    "statements": 8,
+    "tests": 1000,
+    "tests_per_suite": 100,
+    "calls": 20,
+    "hot": 50,
+    "overlap": 0.2,
+    "changes": 10,
+    "seed": 42,
+}
+
+
+def parse_arguments() -> argparse.Namespace:
+    """
+    Define and parse program arguments.
+
+    :return: arguments captured in object.
+    """
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--generator", required=True, help="Path to binary_rts_generator.")
+    parser.add_argument("--binaryrts-root", required=True, help="BinaryRTS repository (for GoogleTest and listener).")
+    parser.add_argument("--dynamorio", required=True, help="DynamoRIO root directory (containing bin64/drrun).")
+    parser.add_argument("--client", required=True, help="BinaryRTS DynamoRIO client library.")
+    parser.add_argument("--resolver", required=True, help="Path to binary_rts_resolver.")
+    parser.add_argument("--cli", default="binaryrts", help="BinaryRTS CLI executable (default: binaryrts).")
+    parser.add_argument("--work-dir", "-w", default="synthetic", help="Working directory (will be cleaned).")
+    parser.add_argument("--jobs", "-j", type=int, default=os.cpu_count(), help="Parallel build jobs.")
+    parser.add_argument("--output", "-o", help="Output JSON file (default: stdout).")
+    for option, default in GENERATOR_OPTIONS.items():
+        parser.add_argument(f"--{option.replace('_', '-')}", type=type(default), default=default)
+    return parser.parse_args()
+
+
+class Pipeline:
+    def __init__(self, args: argparse.Namespace) -> None:
+        self.args = args
+        self.work_dir: Path = Path(args.work_dir).resolve()
+        self.project_dir: Path = self.work_dir / "project"
+        self.build_dir: Path = self.work_dir / "build"
+        self.log_dir: Path = self.work_dir / "logs"
+        self.traces_dir: Path = self.work_dir / "traces"
+        self.selection_dir: Path = self.work_dir / "selection"
+        self.stages: Dict[str, Dict] = {}
+
+    def run_stage(self, name: str, command: List[str], cwd: Optional[Path] = None) -> None:
+        """
+        Runs a single stage and records its wall time and peak RSS (of the stage process and its children).
+        """
+        print(f"Running {name}: {' '.join(command)}", file=sys.stderr)
+        start: float = time.perf_counter()
+        process = subprocess.Popen(command, cwd=cwd or self.work_dir, stdout=subprocess.DEVNULL)
+        peak_rss_kb: Optional[int] = None
+        if hasattr(os, "wait4"):
+            _, status, usage = os.wait4(process.pid, 0)
+            returncode: int = os.waitstatus_to_exitcode(status)
+            # ru_maxrss is in KB on Linux, but in bytes on macOS.
+            peak_rss_kb = usage.ru_maxrss // 1024 if platform.system() == "Darwin" else usage.ru_maxrss
+        else:
+            returncode = process.wait()
+        wall_s: float = time.perf_counter() - start
+        if returncode != 0:
+            raise RuntimeError(f"Stage {name} failed with exit code {returncode}")
+        self.stages[name] = {"wall_s": wall_s, "peak_rss_kb": peak_rss_kb}
+
+    def generate(self, changes: int) -> List[str]:
+        command: List[str] = [self.args.generator, "-output", str(self.project_dir)]
+        for option in GENERATOR_OPTIONS:
+            if option != "changes":
+                command += [f"-{option}", str(getattr(self.args, option))]
+        return command + ["-changes", str(changes)]
+
+    def git(self, *args: str) -> None:
+        subprocess.run(
+            ["git", "-c", "user.name=binaryrts", "-c", "user.email=binaryrts@localhost", *args],
+            cwd=self.project_dir,
+            check=True,
+            stdout=subprocess.DEVNULL,
+        )
+
+    def run(self) -> Dict:
+        shutil.rmtree(self.work_dir, ignore_errors=True)
+        self.work_dir.mkdir(parents=True)
+        self.log_dir.mkdir()
+        self.traces_dir.mkdir()
+        self.selection_dir.mkdir()
+        exe_name: str = f"{TEST_MODULE}.exe" if platform.system() == "Windows" else TEST_MODULE
+        drrun: Path = Path(self.args.dynamorio) / "bin64" / ("drrun.exe" if platform.system() == "Windows" else "drrun")
+        # Only escape metacharacters, the resolver uses ECMAScript regexes.
+        source_regex: str = re.sub(r"([.^$*+?()\[\]{}|\\])", r"\\\1", str(self.project_dir)) + ".*"
+
+        self.run_stage("generate", self.generate(changes=0))
+        self.git("init", "-q", ".")
+        self.git("add", "-A")
+        self.git("commit", "-q", "-m", "Base version")
+
+        self.run_stage(
+            "configure",
+            ["cmake", "-S", str(self.project_dir), "-B", str(self.build_dir), "-DCMAKE_BUILD_TYPE=Debug",
+             f"-DBINARY_RTS_ROOT={Path(self.args.binaryrts_root).resolve()}"],
+        )
+        self.run_stage("build", ["cmake", "--build", str(self.build_dir), "-j", str(self.args.jobs)])
+
+        # The test module is named after the directory of its dumps.
+        modules_file: Path = self.work_dir / "modules.txt"
+        modules_file.write_text(f"{exe_name}\n*synth_lib*\n")
+        module_log_dir: Path = self.log_dir / TEST_MODULE
+        module_log_dir.mkdir()
+        self.run_stage(
+            "collect",
+            [str(drrun), "-c", str(Path(self.args.client).resolve()), "-logdir", str(module_log_dir),
+             "-modules", str(modules_file), "-runtime_dump", "--", str(self.build_dir / "bin" / exe_name)],
+            cwd=module_log_dir,
+        )
+        self.run_stage(
+            "resolve",
+            [str(Path(self.args.resolver).resolve()), "-root", str(self.log_dir), "-ext", ".log",
+             "-regex", source_regex],
+        )
+        self.run_stage(
+            "convert",
+            [self.args.cli, "convert", "-i", str(self.log_dir), "-o", str(self.traces_dir), "--regex", source_regex,
+             "--repo", str(self.project_dir), "cpp"],
+        )
+
+        self.run_stage("change", self.generate(changes=self.args.changes))
+        self.git("add", "-A")
+        self.git("commit", "-q", "-m", "Change functions")
+        self.run_stage(
+            "select",
+            [self.args.cli, "select", "-f", "HEAD~1", "-t", "HEAD", "--repo", str(self.project_dir),
+             "-o", str(self.selection_dir), "cpp",
+             "--lookup", str(self.traces_dir / "function-lookup.csv"),
+             "--traces", str(self.traces_dir / "test-function-traces.csv")],
+        )
+
+        return {
+            "platform": platform.platform(),
+            "options": {option: getattr(self.args, option) for option in GENERATOR_OPTIONS},
+            "sizes": self.collect_sizes(exe_name),
+            "stages": self.stages,
+            "selection": self.evaluate_selection(),
+        }
+
+    def collect_sizes(self, exe_name: str) -> Dict[str, int]:
+        bin_dir: Path = self.build_dir / "bin"
+        return {
+            "binary_bytes": sum(
+                file.stat().st_size for file in bin_dir.iterdir()
+                if file.is_file() and (file.name == exe_name or "synth_lib" in file.name)
+            ),
+            "dump_bytes": sum(file.stat().st_size for file in self.log_dir.rglob("*.log")),
+            "dumps": len((self.log_dir / TEST_MODULE / "dump-lookup.log").read_text().splitlines()),
+        }
+
+    def evaluate_selection(self) -> Dict:
+        def read_tests(file: Path) -> Set[str]:
+            return {line.strip() for line in file.read_text().splitlines() if line.strip() != ""}
+
+        expected: Set[str] = read_tests(self.project_dir / EXPECTED_AFFECTED_FILE)
+        selected: Set[str] = read_tests(self.selection_dir / INCLUDED_TESTS_FILE)
+        if "*" in selected:
+            return {"expected": len(expected), "selected": "*", "precision": None, "recall": 1.0}
+        hits: int = len(expected & selected)
+        return {
+            "expected": len(expected),
+            "selected": len(selected),
+            "precision": hits / len(selected) if len(selected) > 0 else None,
+            "recall": hits / len(expected) if len(expected) > 0 else None,
+        }
+
+
+def main():
+    # Parse arguments
+    args = parse_arguments()
+
+    results: Dict = Pipeline(args).run()
+
+    output: str = json.dumps(results, indent=2)
+    if args.output:
+        Path(args.output).write_text(output)
+    else:
+        print(output)
+
+
+if __name__ == "__main__":
+    main()
@@ -5,15 +5,20 @@
 #include <cstdlib>
 #include <vector>
 #include <sstream>
+#include <unordered_set>
 
 #include "test_listener.h"
 #include "dr_annotations.h"
 
 #ifdef __linux__
-    #include <unistd.h>  // readlink()
+    #include <unistd.h>  // readlink(), link(), write()
+    #include <fcntl.h>   // open()
     #include <cstdint>
+    #include <ctime>     // clock_gettime()
+    #include <sys/resource.h> // getrusage()
 #elif _WIN32
-    #include <windows.h> // GetModuleFileName()
+    #include <windows.h> // GetModuleFileName(), GetProcessTimes()
+    #include <psapi.h>   // K32GetProcessMemoryInfo()
 #endif
 
 #define DEBUG 0
@@ -37,6 +42,17 @@ namespace {
         return result;
     }
 
+    // With GoogleTest sharding, each shard dumps its own global setup (as GLOBAL_TEST_SETUP___shard<N>, the CLI
+    // strips the suffix and merges the shards).
+    std::string getGlobalTestSetupDumpIdentifier() {
+        const char *totalShards = std::getenv("GTEST_TOTAL_SHARDS");
+        const char *shardIndex = std::getenv("GTEST_SHARD_INDEX");
+        if (totalShards == nullptr || shardIndex == nullptr || std::atoi(totalShards) <= 1) {
+            return globalTestSetupDumpIdentifier;
+        }
+        return std::string(globalTestSetupDumpIdentifier) + "___shard" + std::to_string(std::atoi(shardIndex));
+    }
+
     std::string getCurrentExecutableName() {
         std::string executableName;
 #ifdef __linux__
@@ -55,6 +71,192 @@ namespace {
 #endif
         return executableName;
     }
+
+    /*
+     * Turns an excluded test `module!!!Suite!!!Case` into `Suite.Case` (or `Suite` for excluded suites).
+     * Returns false for empty lines and tests of other test executables.
+     */
+    bool parseExcludedTest(std::string line, const std::string &executableName, std::string &testName) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::size_t moduleIdEnd = line.find(testIdSeparator);
+        if (moduleIdEnd == std::string::npos) {
+            return false;
+        }
+        // Excludes files may contain tests of all test executables, only keep ours (`*` matches any executable).
+        std::string moduleName = line.substr(0, moduleIdEnd);
+        if (!executableName.empty() && moduleName != "*" && moduleName != executableName &&
+            moduleName != executableName.substr(0, executableName.rfind('.'))) {
+            return false;
+        }
+        testName = line.substr(moduleIdEnd + testIdSeparator.size());
+        std::size_t suiteIdEnd = testName.find(testIdSeparator);
+        if (suiteIdEnd != std::string::npos) {
+            std::string testCase = testName.substr(suiteIdEnd + testIdSeparator.size());
+            testName.resize(suiteIdEnd);
+            if (testCase != "*") {
+                testName += BinaryRTSTestListener::TestCaseSeparator + testCase;
+            }
+        }
+        return !testName.empty();
+    }
+
+    // Excluded tests (`Suite.Case`) and suites (`Suite`) of the current test executable.
+    std::unordered_set<std::string> excludedTests;
+
+    const char *testResourcesFileName = "test-resources.csv";
+
+    struct ResourceUsage {
+        int64_t wallTimeUs = 0;
+        int64_t cpuTimeUs = 0;
+    };
+
+    // Resources at the start of the current test, and the per-run resources file (if BINARY_RTS_LOGDIR is set).
+    ResourceUsage testStartUsage;
+#ifdef __linux__
+    int testResourcesFile = -1;
+#elif _WIN32
+    HANDLE testResourcesFile = INVALID_HANDLE_VALUE;
+#endif
+
+    ResourceUsage getResourceUsage() {
+        ResourceUsage usage;
+#ifdef __linux__
+        struct timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        usage.wallTimeUs = static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        usage.cpuTimeUs = static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#elif _WIN32
+        LARGE_INTEGER counter, frequency;
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        usage.wallTimeUs = counter.QuadPart / frequency.QuadPart * 1000000 +
+                           counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+        FILETIME creationTime, exitTime, kernelTime, userTime;
+        if (GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+            // FILETIMEs count 100ns intervals.
+            uint64_t kernel = (static_cast<uint64_t>(kernelTime.dwHighDateTime) << 32) | kernelTime.dwLowDateTime;
+            uint64_t user = (static_cast<uint64_t>(userTime.dwHighDateTime) << 32) | userTime.dwLowDateTime;
+            usage.cpuTimeUs = static_cast<int64_t>((kernel + user) / 10);
+        }
+#endif
+        return usage;
+    }
+
+    // Resets the peak RSS of the process (Linux >= 4.0), such that the peak after a test is the test's peak.
+    void resetPeakMemory() {
+#ifdef __linux__
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        clearRefs << "5";
+#endif
+    }
+
+    // Peak resident set size in KB, since the last resetPeakMemory() if supported, otherwise of the whole run.
+    int64_t getPeakMemoryKb() {
+#ifdef __linux__
+        struct rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            return usage.ru_maxrss;
+        }
+#elif _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return static_cast<int64_t>(counters.PeakWorkingSetSize / 1024);
+        }
+#endif
+        return 0;
+    }
+
+    /*
+     * Creates `path` with `header` as its content, unless it exists already. The header is written to a file of this
+     * process first, which is then linked (moved on Windows) to `path`, such that the file never exists without header.
+     */
+    void createWithHeader(const std::string &path, const std::string &header) {
+#ifdef __linux__
+        std::string tempPath = path + "." + std::to_string(getpid()) + ".tmp";
+#elif _WIN32
+        std::string tempPath = path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+#else
+        std::string tempPath = path + ".tmp";
+#endif
+        {
+            std::ofstream temp(tempPath, std::ios::binary | std::ios::trunc);
+            temp << header;
+        }
+#ifdef __linux__
+        link(tempPath.c_str(), path.c_str());
+#elif _WIN32
+        MoveFileExA(tempPath.c_str(), path.c_str(), 0);
+#endif
+        std::remove(tempPath.c_str());
+    }
+
+    // Opens `path` such that every write is appended atomically, also if other processes append to it.
+    bool openForAppend(const std::string &path) {
+#ifdef __linux__
+        testResourcesFile = open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        return testResourcesFile != -1;
+#elif _WIN32
+        testResourcesFile = CreateFileA(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        return testResourcesFile != INVALID_HANDLE_VALUE;
+#else
+        return false;
+#endif
+    }
+
+    // Appends `line` with a single write, such that lines of concurrent processes never interleave.
+    void appendLine(const std::string &line) {
+#ifdef __linux__
+        if (write(testResourcesFile, line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+            std::cerr << "Failed to append to " << testResourcesFileName << "\n";
+        }
+#elif _WIN32
+        DWORD written = 0;
+        if (!WriteFile(testResourcesFile, line.data(), static_cast<DWORD>(line.size()), &written, nullptr) ||
+            written != line.size()) {
+            std::cerr << "Failed to append to " << testResourcesFileName << "\n";
+        }
+#else
+        (void) line;
+#endif
+    }
+
+    // Opens `test-resources.csv` in BINARY_RTS_LOGDIR (if set), creating it with its header if it does not exist.
+    bool openTestResourcesFile() {
+        const char *logDir = std::getenv("BINARY_RTS_LOGDIR");
+        if (logDir == nullptr) {
+            return false;
+        }
+        std::string path = std::string(logDir) + "/" + testResourcesFileName;
+        createWithHeader(path, "module,test,result,wall_us,cpu_us,peak_rss_kb\n");
+        if (!openForAppend(path)) {
+            std::cerr << "Failed to open " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * Appends a test to `test-resources.csv` next to `dump-lookup.log` (in BINARY_RTS_LOGDIR), which is shared
+     * by all test executables of a run: `module,test,result,wall_us,cpu_us,peak_rss_kb`.
+     */
+    void recordTestResources(const std::string &testIdentifier, const std::string &result) {
+        static const bool fileOpened = openTestResourcesFile();
+        if (!fileOpened) {
+            return;
+        }
+        ResourceUsage usage = getResourceUsage();
+        static const std::string executableName = getCurrentExecutableName();
+        std::ostringstream line;
+        line << executableName << "," << testIdentifier << "," << result << ","
+             << usage.wallTimeUs - testStartUsage.wallTimeUs << ","
+             << usage.cpuTimeUs - testStartUsage.cpuTimeUs << ","
+             << getPeakMemoryKb() << "\n";
+        appendLine(line.str());
+    }
 }
 
 const std::string BinaryRTSTestListener::TestCaseSeparator = ".";
@@ -65,11 +267,21 @@ int BinaryRTSTestListener::testSuiteCounter = 0;
 std::string BinaryRTSTestListener::currentTestIdentifier;
 std::string BinaryRTSTestListener::currentTestSuiteIdentifier;
 
+#ifdef __linux__
+// Defined by binary_rts_sancov, if linked (i.e., tests are instrumented with -fsanitize-coverage instead of DynamoRIO).
+extern "C" void binary_rts_sancov_dump(const char *dumpId) __attribute__((weak));
+#endif
+
 void DumpCoverage(const char *dumpId) {
 #if DEBUG
     std::cout << "Dumping with ID: " << dumpId << std::endl;
 #endif
     DR_LOG(dumpId);
+#ifdef __linux__
+    if (binary_rts_sancov_dump != nullptr) {
+        binary_rts_sancov_dump(dumpId);
+    }
+#endif
     }
 
 void BinaryRTSTestListener::TestProgramStart() {
@@ -83,7 +295,7 @@ void BinaryRTSTestListener::TestSuiteStart(const std::string &testSuiteIdentifie
         isCurrentTestSuiteParameterized = true;
     }
     if (testSuiteCounter++ == 0) {
-        DumpCoverage(globalTestSetupDumpIdentifier);
+        DumpCoverage(getGlobalTestSetupDumpIdentifier().c_str());
     }
 }
 
@@ -93,9 +305,13 @@ void BinaryRTSTestListener::TestStart(const std::string &testIdentifier) {
         std::string message = std::string(currentTestSuiteIdentifier + "___setup");
         DumpCoverage(message.c_str());
     }
+    // Start measuring after the setup dump, such that dumps are not accounted to the test.
+    resetPeakMemory();
+    testStartUsage = getResourceUsage();
 }
 
 void BinaryRTSTestListener::TestEnd(const std::string &result) {
+    recordTestResources(currentTestIdentifier, result);
     // Trigger coverage dump after each test case for test-specific coverage.
     // We encode the test result in the dump identifier.
     if (enableParameterizedTests || !isCurrentTestSuiteParameterized) {
@@ -113,7 +329,7 @@ void BinaryRTSTestListener::TestSuiteEnd(const std::string &result) {
 
 void BinaryRTSTestListener::TestProgramEnd() {
     testSuiteCounter = 0;
-    DumpCoverage(globalTestSetupDumpIdentifier);
+    DumpCoverage(getGlobalTestSetupDumpIdentifier().c_str());
 }
 
 std::string
@@ -138,22 +354,19 @@ ParseExcludesFileToGoogleTestFilter(const std::string &path, const std::string &
 
     if (file.is_open()) {
         std::string line;
+        std::string testName;
         uint64_t counter = 0;
         while (std::getline(file, line)) {
-            // Remove test module name (i.e., test executable name) prefix from identifier.
-            std::size_t moduleIdEnd = line.find(testIdSeparator);
-            // TODO: We could filter here based on the executable name.
-//            if (!executableName.empty()) {
-//                std::string moduleName = line.substr(0, moduleIdEnd);
-//                if (moduleName != executableName)
-//                    continue;
-//            }
-            line = line.substr(moduleIdEnd + testIdSeparator.size());
-            line.replace(line.find(testIdSeparator), testIdSeparator.size(), ".");
+            if (!parseExcludedTest(line, executableName, testName)) {
+                continue;
+            }
+            if (testName.find(BinaryRTSTestListener::TestCaseSeparator) == std::string::npos) {
+                testName += ".*";
+            }
             if (counter > 0) {
                 testFilter += ":";
             }
-            testFilter += line;
+            testFilter += testName;
             ++counter;
         }
         std::cout << "Found " << counter << " tests: " << testFilter << "\n";
@@ -163,6 +376,36 @@ ParseExcludesFileToGoogleTestFilter(const std::string &path, const std::string &
     return testFilter;
 }
 
+size_t LoadTestExcludesFile(const std::string &path) {
+    std::ifstream file(path);
+    std::cout << "Starting to load excluded tests from " << path << "\n";
+
+    std::string executableName = getCurrentExecutableName();
+
+    excludedTests.clear();
+    if (file.is_open()) {
+        std::string line;
+        std::string testName;
+        while (std::getline(file, line)) {
+            if (parseExcludedTest(line, executableName, testName)) {
+                excludedTests.insert(testName);
+            }
+        }
+        file.close();
+    }
+    std::cout << "Found " << excludedTests.size() << " excluded tests for " << executableName << "\n";
+
+    return excludedTests.size();
+}
+
+bool IsTestExcluded(const std::string &testSuiteIdentifier, const std::string &testIdentifier) {
+    if (excludedTests.empty()) {
+        return false;
+    }
+    return excludedTests.count(testSuiteIdentifier) > 0 ||
+           excludedTests.count(testSuiteIdentifier + BinaryRTSTestListener::TestCaseSeparator + testIdentifier) > 0;
+}
+
 const char *GetTestExcludesFileFromEnv() {
     return std::getenv("GTEST_EXCLUDES_FILE");
 }
@@ -1,10 +1,14 @@
 #ifndef BINARY_RTS_TEST_LISTENER_H
 #define BINARY_RTS_TEST_LISTENER_H
 
+#include <cstddef>
 #include <string>
 
 /*
  * Singleton that keeps track of executed tests and emits event messages to DynamoRIO.
+ * If BINARY_RTS_LOGDIR is set, the wall time, CPU time and peak RSS of each test (from TestStart to TestEnd)
+ * are appended to `test-resources.csv` in that directory, e.g., to schedule selected tests by runtime.
+ * Each line is appended with a single write, such that concurrent test executables and shards can share the file.
  */
 class BinaryRTSTestListener {
 public:
@@ -43,6 +47,21 @@ private:
  */
 std::string ParseExcludesFileToGoogleTestFilter(const std::string &path, const std::string &previousFilter);
 
+/*
+ * Loads the excluded tests of the current test executable from the provided excluded.txt file into a hash set.
+ * Unlike a GoogleTest filter with one pattern per excluded test, checking a test with IsTestExcluded
+ * takes constant time, hence large excludes files do not slow down the start of the test program.
+ * Returns the number of excluded tests (and suites).
+ */
+size_t LoadTestExcludesFile(const std::string &path);
+
+/*
+ * Checks if the test (or its whole suite) was excluded by LoadTestExcludesFile,
+ * to be called in OnTestStart to skip excluded tests with GTEST_SKIP. Skipped tests must not call TestStart
+ * and TestEnd, otherwise their dump replaces the coverage of their last run.
+ */
+bool IsTestExcluded(const std::string &testSuiteIdentifier, const std::string &testIdentifier);
+
 /*
  * Searches for GoogleTest exclusion file in environment and returns file path (if any). 
  */
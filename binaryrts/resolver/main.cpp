@@ -1,7 +1,9 @@
 #include "dr_api.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <cassert>
+#include <thread>
 
 #include "resolver.h"
 
@@ -15,6 +17,8 @@ initOptions(int argc, const char *argv[], ResolverOptions &opts) {
     opts.root = ".";
     opts.resolveSymbols = true;
     opts.debug = false;
+    opts.stream = "";
+    opts.jobs = 1;
 
     for (int i = 1; i < argc; i++) {
         token = argv[i];
@@ -29,6 +33,15 @@ initOptions(int argc, const char *argv[], ResolverOptions &opts) {
             opts.root = argv[++i];
         } else if (token == "-extracted") {
             opts.resolveSymbols = false;
+        } else if (token == "-stream") {
+            assert(("Missing stream path", (i + 1) < argc));
+            opts.stream = argv[++i];
+        } else if (token == "-jobs") {
+            assert(("Missing number of jobs", (i + 1) < argc));
+            opts.jobs = std::stoul(argv[++i]);
+            if (opts.jobs == 0) {
+                opts.jobs = std::max(1u, std::thread::hardware_concurrency());
+            }
         } else if (token == "-debug") {
             opts.debug = true;
         }
@@ -49,7 +62,9 @@ main(int argc, const char *argv[]) {
                 << "Called BinaryRTS symbol resolver with options:\n"
                 << "-ext: " << opts.ext << "\n"
                 << "-regex: " << opts.regex << "\n"
-                << "-root: " << opts.root << std::endl;
+                << "-root: " << opts.root << "\n"
+                << "-stream: " << opts.stream << "\n"
+                << "-jobs: " << opts.jobs << std::endl;
         SymbolResolver resolver{opts};
         resolver.run();
         dr_standalone_exit();
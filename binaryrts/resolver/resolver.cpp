@@ -1,8 +1,14 @@
 #include "dr_api.h"
 #include "drsyms.h"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <string>
 #include <filesystem>
+#include <vector>
+#include <mutex>
+#include <thread>
 
 #include "resolver.h"
 
@@ -14,68 +20,152 @@ namespace {
     const char *FINAL_DUMP_FILE = "coverage.log";  // irrelevant coverage file
     const size_t MAX_SYM_RESULT = 256;
     const size_t MAX_LINE_LENGTH = 1024;
+
+    // Shards of a sharded GoogleTest run write `shard<N>_coverage.log` (or `<dump_prefix>coverage.log`).
+    bool isFinalDumpFile(const std::string &fileName) {
+        const std::string finalDumpFile(FINAL_DUMP_FILE);
+        return fileName.size() >= finalDumpFile.size() &&
+               fileName.compare(fileName.size() - finalDumpFile.size(), finalDumpFile.size(), finalDumpFile) == 0;
+    }
 }
 
 namespace fs = std::filesystem;
 
-CoveredSymbol *
-SymbolCache::findSymbol(const std::string &moduleName, const size_t offset) {
-    SymbolMap *symbolMap = nullptr;
-    bool isSameAsLastQueriedSymbol = false;
-
-    // Check for last queried module.
-    if (lastQueriedModule.has_value() && lastQueriedModule.value().first == moduleName) {
-        symbolMap = lastQueriedModule.value().second;
-        // Check for last queried symbol.
-        if (lastQueriedSymbol.has_value()) {
-            if (lastQueriedSymbol.value().first == offset) {
-                return lastQueriedSymbol.value().second;
-            } else if (lastQueriedSymbol.value().second->isSameSymbol(offset)) {
-                // In case we found the same symbol with a different offset, we should add it to the cache, if it doesn't exist.
-                isSameAsLastQueriedSymbol = true;
-            }
-        }
+const CoveredSymbol *
+SymbolCache::findSymbol(const std::string &moduleName, const size_t offset, bool &isKnown) const {
+    const ModuleSymbols *module = findModule(moduleName);
+    if (module == nullptr) {
+        isKnown = false;
+        return nullptr;
     }
+    return findSymbol(*module, offset, isKnown);
+}
 
-    if (symbolMap == nullptr) {
-        symbolMap = &modules[moduleName];
+namespace {
+    // Returns the first interval that starts after offset.
+    std::vector<SymbolCache::SymbolInterval>::const_iterator
+    nextInterval(const std::vector<SymbolCache::SymbolInterval> &intervals, const size_t offset) {
+        return std::upper_bound(intervals.begin(), intervals.end(), offset,
+                                [](size_t value, const SymbolCache::SymbolInterval &other) {
+                                    return value < other.start;
+                                });
     }
 
-    // Lookup by offset.
-    std::unique_ptr<CoveredSymbol> &entry = (*symbolMap)[offset];
-    if (entry) {
-        return entry.get();
+    // Returns the interval that contains offset, or nullptr.
+    const SymbolCache::SymbolInterval *
+    findInterval(const std::vector<SymbolCache::SymbolInterval> &intervals, const size_t offset) {
+        auto interval = nextInterval(intervals, offset);
+        if (interval != intervals.begin() && offset < (--interval)->end) {
+            return &*interval;
+        }
+        return nullptr;
     }
-    entry = std::make_unique<CoveredSymbol>();
 
-    CoveredSymbol *symbol = entry.get();
-    symbol->offset = offset;
+    // Minimum number of pending intervals before they are merged, the batch grows with the square root of the
+    // module's intervals, which keeps adding n symbols one by one at O(n * sqrt(n)) moves.
+    const size_t MIN_PENDING_INTERVALS = 64;
+}
 
-    if (isSameAsLastQueriedSymbol) {
-        CoveredSymbol *lastSymbol = lastQueriedSymbol.value().second;
-        symbol->start = lastSymbol->start;
-        symbol->end = lastSymbol->end;
-        symbol->name = lastSymbol->name;
-        symbol->file = lastSymbol->file;
-        symbol->line = lastSymbol->line;
-        symbol->status = lastSymbol->status;
-    } else {
-        symbol->status = CoveredSymbol::SymbolStatus::UNRESOLVED;
-        // Update last queried module and symbol.
-        lastQueriedModule.emplace(std::make_pair(moduleName, symbolMap));
-        lastQueriedSymbol.emplace(std::make_pair(offset, symbol));
+const CoveredSymbol *
+SymbolCache::findSymbol(const ModuleSymbols &module, const size_t offset, bool &isKnown) {
+    const SymbolInterval *interval = findInterval(module.intervals, offset);
+    if (interval == nullptr) {
+        interval = findInterval(module.pendingIntervals, offset);
+    }
+    if (interval != nullptr) {
+        isKnown = true;
+        return interval->symbol;
     }
+    isKnown = module.isComplete || module.unresolvedOffsets.count(offset) > 0;
+    return nullptr;
+}
 
-    return symbol;
+const SymbolCache::ModuleSymbols *
+SymbolCache::findModule(const std::string &moduleName) const {
+    auto module = modules.find(moduleName);
+    return module != modules.end() ? &module->second : nullptr;
+}
+
+const CoveredSymbol *
+SymbolCache::addSymbol(const std::string &moduleName, const size_t offset, CoveredSymbol &&symbol) {
+    ModuleSymbols &module = modules[moduleName];
+    // The interval has to contain offset (drsyms reports empty ranges for some symbols) and must not overlap
+    // its neighbours, which do not contain offset (otherwise, we would not resolve it).
+    size_t start = std::min(symbol.start, offset);
+    size_t end = std::max(symbol.end, offset + 1);
+    for (const auto *intervals: {&module.intervals, &module.pendingIntervals}) {
+        auto next = nextInterval(*intervals, offset);
+        if (next != intervals->begin()) {
+            start = std::max(start, std::prev(next)->end);
+        }
+        if (next != intervals->end()) {
+            end = std::min(end, next->start);
+        }
+    }
+    symbol.start = start;
+    symbol.end = end;
+    const CoveredSymbol *entry = &module.symbols.emplace_back(std::move(symbol));
+    module.pendingIntervals.insert(nextInterval(module.pendingIntervals, offset), SymbolInterval{start, end, entry});
+
+    size_t maxPending = std::max(MIN_PENDING_INTERVALS,
+                                 static_cast<size_t>(std::sqrt(static_cast<double>(module.intervals.size()))));
+    if (module.pendingIntervals.size() >= maxPending) {
+        size_t merged = module.intervals.size();
+        module.intervals.insert(module.intervals.end(), module.pendingIntervals.begin(),
+                                module.pendingIntervals.end());
+        std::inplace_merge(module.intervals.begin(), module.intervals.begin() + merged, module.intervals.end(),
+                           [](const SymbolInterval &a, const SymbolInterval &b) { return a.start < b.start; });
+        module.pendingIntervals.clear();
+    }
+    return entry;
+}
+
+const SymbolCache::ModuleSymbols &
+SymbolCache::addModuleSymbols(const std::string &moduleName, std::deque<CoveredSymbol> &&symbols) {
+    ModuleSymbols &module = modules[moduleName];
+    if (module.isComplete) {
+        return module;
+    }
+    module.isComplete = true;
+    module.symbols = std::move(symbols);
+    module.intervals.clear();
+    module.pendingIntervals.clear();
+
+    // Sort once and clip overlapping symbols (the first symbol of an offset wins).
+    std::vector<CoveredSymbol *> sortedSymbols;
+    sortedSymbols.reserve(module.symbols.size());
+    for (auto &symbol: module.symbols) {
+        sortedSymbols.push_back(&symbol);
+    }
+    std::stable_sort(sortedSymbols.begin(), sortedSymbols.end(),
+                     [](const CoveredSymbol *a, const CoveredSymbol *b) { return a->start < b->start; });
+    CoveredSymbol *previous = nullptr;
+    for (auto symbol: sortedSymbols) {
+        if (previous != nullptr && previous->start == symbol->start) {
+            continue;
+        }
+        if (previous != nullptr && previous->end > symbol->start) {
+            previous->end = symbol->start;
+        }
+        previous = symbol;
+    }
+    module.intervals.reserve(sortedSymbols.size());
+    for (auto symbol: sortedSymbols) {
+        if (module.intervals.empty() || module.intervals.back().start != symbol->start) {
+            module.intervals.push_back(SymbolInterval{symbol->start, symbol->end, symbol});
+        }
+    }
+    return module;
 }
 
 void
 SymbolCache::loadSymbolsFromDisk(const std::string &moduleName, const fs::path &modulePath) {
-    // This will create an empty map for the module in any case.
-    SymbolMap *symbolMap = &modules[moduleName];
+    // This will create an empty (but complete) index for the module in any case.
+    std::deque<CoveredSymbol> symbols;
     fs::path symbolsFile = modulePath.parent_path() / (moduleName + ".binaryrts");
     if (!fs::exists(symbolsFile)) {
         printf("ERROR: Could not locate symbols file at %s\n", symbolsFile.string().c_str());
+        addModuleSymbols(moduleName, std::move(symbols));
         return;
     }
 
@@ -84,28 +174,33 @@ SymbolCache::loadSymbolsFromDisk(const std::string &moduleName, const fs::path &
     char buffer[MAX_LINE_LENGTH];
     while (fgets(buffer, MAX_LINE_LENGTH, fp)) {
         size_t offset;
+        size_t end = 0;
         char file[MAXIMUM_PATH];
         char name[MAX_SYM_RESULT];
         uint64_t line;
-        sscanf(buffer,
-               "0x%zx" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%lu\n",
-               &offset,
-               file,
-               name,
-               &line);
-        std::unique_ptr<CoveredSymbol> &entry = (*symbolMap)[offset];
-        if (!entry) {
-            entry = std::make_unique<CoveredSymbol>();
-            entry->offset = offset;
-            entry->file = std::string(file);
-            entry->line = line;
-            entry->start = offset;
-            entry->end = offset;
-            entry->name = std::string(name);
-            entry->status = CoveredSymbol::SymbolStatus::RESOLVED;
+        // The end offset is only extracted for symbols, lines (and older symbol files) cover a single offset.
+        int fields = sscanf(buffer,
+                            "0x%zx" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%s" NON_FILE_PATH_SEP "%lu"
+                            NON_FILE_PATH_SEP "0x%zx\n",
+                            &offset,
+                            file,
+                            name,
+                            &line,
+                            &end);
+        if (fields < 4) {
+            continue;
         }
+        CoveredSymbol &symbol = symbols.emplace_back();
+        symbol.offset = offset;
+        symbol.file = std::string(file);
+        symbol.line = line;
+        symbol.start = offset;
+        symbol.end = fields == 5 && end > offset ? end : offset + 1;
+        symbol.name = std::string(name);
+        symbol.status = CoveredSymbol::SymbolStatus::RESOLVED;
     }
     fclose(fp);
+    addModuleSymbols(moduleName, std::move(symbols));
 }
 
 void
@@ -132,84 +227,183 @@ SymbolResolver::cleanupSymbolServer() {
 }
 
 const CoveredSymbol *
-SymbolResolver::findSymbol(const std::string &moduleName, const fs::path &modulePath, const size_t offset) {
+SymbolResolver::findSymbol(const ModuleCoverage &module, const size_t offset) {
+    if (module.symbols == nullptr) {
+        return resolveSymbol(module.moduleName, module.modulePath, offset);
+    }
+    // Complete modules are never modified, hence there is no need to lock (or count) anything per offset.
+    bool isKnown;
+    const CoveredSymbol *symbol = SymbolCache::findSymbol(*module.symbols, offset, isKnown);
+    return symbol != nullptr && symbol->status == CoveredSymbol::SymbolStatus::RESOLVED ? symbol : nullptr;
+}
+
+const SymbolCache::ModuleSymbols &
+SymbolResolver::loadModuleSymbols(const std::string &moduleName, const fs::path &modulePath) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    const SymbolCache::ModuleSymbols *module = cache.findModule(moduleName);
+    if (module != nullptr && module->isComplete) {
+        return *module;
+    }
+    if (!options.resolveSymbols) {
+        cache.loadSymbolsFromDisk(moduleName, modulePath);
+        return *cache.findModule(moduleName);
+    }
+    return cache.addModuleSymbols(moduleName, enumerateModuleSymbols(modulePath));
+}
+
+namespace {
+    struct EnumeratedSymbol {
+        size_t start;
+        size_t end;
+    };
+
+    bool enumerateSymbolsCb(drsym_info_t *info, drsym_error_t status, void *data) {
+        static_cast<std::vector<EnumeratedSymbol> *>(data)->push_back(
+                EnumeratedSymbol{info->start_offs, info->end_offs});
+        return true;
+    }
+}
+
+std::deque<CoveredSymbol>
+SymbolResolver::enumerateModuleSymbols(const fs::path &modulePath) {
+    std::deque<CoveredSymbol> symbols;
+    std::vector<EnumeratedSymbol> enumerated;
+    drsym_error_t symres = drsym_enumerate_symbols_ex(
+            modulePath.string().c_str(),
+            enumerateSymbolsCb,
+            sizeof(drsym_info_t),
+            &enumerated,
+            DRSYM_DEFAULT_FLAGS
+    );
+    if (symres != DRSYM_SUCCESS) {
+        if (options.debug)
+            printf("WARN: Failed to enumerate symbols of %s with error %d\n", modulePath.string().c_str(), symres);
+        return symbols;
+    }
+
+    // As for single offsets, file and line of a symbol are those of its function entry. Symbols without line
+    // information (e.g., data) are skipped, and so are aliases of a function that has already been added.
+    std::unordered_set<size_t> starts;
+    char file[MAXIMUM_PATH];
+    char name[MAX_SYM_RESULT];
+    for (const EnumeratedSymbol &function: enumerated) {
+        if (!starts.insert(function.start).second) {
+            continue;
+        }
+        drsym_info_t sym;
+        sym.struct_size = sizeof(sym);
+        sym.name = name;
+        sym.name_size = MAX_SYM_RESULT;
+        sym.file = file;
+        sym.file_size = MAXIMUM_PATH;
+        symbolQueryCounter++;
+        if (drsym_lookup_address(modulePath.string().c_str(), function.start, &sym, DRSYM_DEFAULT_FLAGS) !=
+            DRSYM_SUCCESS || sym.start_offs != function.start) {
+            continue;
+        }
+        CoveredSymbol &symbol = symbols.emplace_back();
+        symbol.offset = function.start;
+        symbol.file = file;
+        symbol.line = sym.line;
+        symbol.name = name;
+        symbol.start = function.start;
+        symbol.end = std::max(function.end, function.start + 1);
+        if (regex.has_value() && !std::regex_match(symbol.file, regex.value())) {
+            symbol.status = CoveredSymbol::SymbolStatus::EXCLUDED;
+        } else {
+            symbol.status = CoveredSymbol::SymbolStatus::RESOLVED;
+        }
+    }
+    if (options.debug)
+        printf("DEBUG: Loaded %zu symbols of %s\n", symbols.size(), modulePath.string().c_str());
+    return symbols;
+}
+
+const CoveredSymbol *
+SymbolResolver::resolveSymbol(const std::string &moduleName, const fs::path &modulePath, const size_t offset) {
     // In case we're not resolving symbols but use pre-extracted symbol information,
     // we need to read them once from disk here.
     if (!options.resolveSymbols && !cache.hasLoadedModule(moduleName)) {
         cache.loadSymbolsFromDisk(moduleName, modulePath);
     }
 
-    CoveredSymbol *symbol = cache.findSymbol(moduleName, offset);
-
-    switch (symbol->status) {
-        case CoveredSymbol::SymbolStatus::RESOLVED:
-            symbolMatchCounter++;
-            return symbol;
-        case CoveredSymbol::SymbolStatus::NOT_FOUND:
-        case CoveredSymbol::SymbolStatus::EXCLUDED:
-            symbolMatchCounter++;
-            return nullptr;
-        default:
-            if (!options.resolveSymbols) {
-                if (options.debug) {
-                    printf("DEBUG: Symbol not found 0x%zx in %s\n", symbol->offset, modulePath.string().c_str());
-                }
-                symbol->status = CoveredSymbol::SymbolStatus::NOT_FOUND;
-                return nullptr;
-            }
-            char file[MAXIMUM_PATH];
-            char name[MAX_SYM_RESULT];
-            drsym_error_t symres;
-            drsym_info_t sym;
-            sym.struct_size = sizeof(sym);
-            sym.name = name;
-            sym.name_size = MAX_SYM_RESULT;
-            sym.file = file;
-            sym.file_size = MAXIMUM_PATH;
-            symres = drsym_lookup_address(
-                    modulePath.string().c_str(),
-                    symbol->offset,
-                    &sym,
-                    DRSYM_DEFAULT_FLAGS
-            );
+    bool isKnown;
+    const CoveredSymbol *symbol = cache.findSymbol(moduleName, offset, isKnown);
+    if (isKnown) {
+        symbolMatchCounter++;
+        return symbol != nullptr && symbol->status == CoveredSymbol::SymbolStatus::RESOLVED ? symbol : nullptr;
+    }
+    // Pre-extracted symbols are complete, hence only drsyms resolves unknown offsets.
+    char file[MAXIMUM_PATH];
+    char name[MAX_SYM_RESULT];
+    drsym_error_t symres;
+    drsym_info_t sym;
+    sym.struct_size = sizeof(sym);
+    sym.name = name;
+    sym.name_size = MAX_SYM_RESULT;
+    sym.file = file;
+    sym.file_size = MAXIMUM_PATH;
+    symres = drsym_lookup_address(
+            modulePath.string().c_str(),
+            offset,
+            &sym,
+            DRSYM_DEFAULT_FLAGS
+    );
+    symbolQueryCounter++;
+
+    if (symres == DRSYM_SUCCESS) {
+        CoveredSymbol resolvedSymbol;
+        resolvedSymbol.offset = offset;
+        resolvedSymbol.line = sym.line;
+        resolvedSymbol.file = file;
+        resolvedSymbol.name = name;
+        resolvedSymbol.start = sym.start_offs;
+        resolvedSymbol.end = sym.end_offs;
+        // The symbol is shared by all offsets of its function, hence we take file and line from the function entry,
+        // which does not depend on the offset that happens to be resolved first (e.g., with -jobs > 1) and is not
+        // the location of inlined code.
+        if (sym.start_offs < offset) {
+            char entryFile[MAXIMUM_PATH];
+            char entryName[MAX_SYM_RESULT];
+            drsym_info_t entry;
+            entry.struct_size = sizeof(entry);
+            entry.name = entryName;
+            entry.name_size = MAX_SYM_RESULT;
+            entry.file = entryFile;
+            entry.file_size = MAXIMUM_PATH;
             symbolQueryCounter++;
-
-            if (symres == DRSYM_SUCCESS) {
-                symbol->line = sym.line;
-                symbol->file = file;
-                symbol->name = name;
-                symbol->start = sym.start_offs;
-                symbol->end = sym.end_offs;
-                if (regex.has_value() && !std::regex_match(symbol->file, regex.value())) {
-                    symbol->status = CoveredSymbol::SymbolStatus::EXCLUDED;
-                } else {
-                    symbol->status = CoveredSymbol::SymbolStatus::RESOLVED;
-                }
-            } else if (symres == DRSYM_ERROR_LOAD_FAILED) {
-                if (options.debug)
-                    printf("WARN: Load failed for symbol 0x%zx in %s\n", symbol->offset, modulePath.string().c_str());
-            } else if (symres == DRSYM_ERROR_SYMBOL_NOT_FOUND) {
-                if (options.debug)
-                    printf("WARN: Symbol not found 0x%zx in %s\n", symbol->offset, modulePath.string().c_str());
-            } else if (symres == DRSYM_ERROR_NOMEM) {
-                if (options.debug)
-                    printf("WARN: Memory leak when querying symbol 0x%zx in %s\n", symbol->offset,
-                           modulePath.string().c_str());
-            } else if (symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
-                if (options.debug)
-                    printf("WARN: Line info not available for symbol 0x%zx in %s (binary may lack debug info)\n",
-                           symbol->offset, modulePath.string().c_str());
-            }
-            // In case we didn't find symbols, we still update the status for the cached offset.
-            if (symbol->status != CoveredSymbol::SymbolStatus::EXCLUDED &&
-                symbol->status != CoveredSymbol::SymbolStatus::RESOLVED) {
-                symbol->status = CoveredSymbol::SymbolStatus::NOT_FOUND;
+            if (drsym_lookup_address(modulePath.string().c_str(), sym.start_offs, &entry, DRSYM_DEFAULT_FLAGS) ==
+                DRSYM_SUCCESS && entry.start_offs == sym.start_offs) {
+                resolvedSymbol.offset = sym.start_offs;
+                resolvedSymbol.line = entry.line;
+                resolvedSymbol.file = entryFile;
             }
-            // We add the start and end offsets to the symbol cache as well.
-            cache.findSymbol(moduleName, symbol->start);
-            cache.findSymbol(moduleName, symbol->end);
-            return symbol->status == CoveredSymbol::SymbolStatus::RESOLVED ? symbol : nullptr;
+        }
+        if (regex.has_value() && !std::regex_match(resolvedSymbol.file, regex.value())) {
+            resolvedSymbol.status = CoveredSymbol::SymbolStatus::EXCLUDED;
+        } else {
+            resolvedSymbol.status = CoveredSymbol::SymbolStatus::RESOLVED;
+        }
+        // All other offsets of the function resolve to the same symbol without querying drsyms again.
+        symbol = cache.addSymbol(moduleName, offset, std::move(resolvedSymbol));
+        return symbol->status == CoveredSymbol::SymbolStatus::RESOLVED ? symbol : nullptr;
+    } else if (symres == DRSYM_ERROR_LOAD_FAILED) {
+        if (options.debug)
+            printf("WARN: Load failed for symbol 0x%zx in %s\n", offset, modulePath.string().c_str());
+    } else if (symres == DRSYM_ERROR_SYMBOL_NOT_FOUND) {
+        if (options.debug)
+            printf("WARN: Symbol not found 0x%zx in %s\n", offset, modulePath.string().c_str());
+    } else if (symres == DRSYM_ERROR_NOMEM) {
+        if (options.debug)
+            printf("WARN: Memory leak when querying symbol 0x%zx in %s\n", offset, modulePath.string().c_str());
+    } else if (symres == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
+        if (options.debug)
+            printf("WARN: Line info not available for symbol 0x%zx in %s (binary may lack debug info)\n",
+                   offset, modulePath.string().c_str());
     }
+    // In case we didn't find symbols, we still remember the offset to not query it again.
+    cache.addUnresolvedOffset(moduleName, offset);
+    return nullptr;
 }
 
 void
@@ -244,6 +438,9 @@ SymbolResolver::analyzeCoverageFile(const fs::path &file) {
                 ModuleCoverage coveredModule;
                 coveredModule.modulePath = line.substr(pathStartPos + 1, lineEndPos - pathStartPos - 1);
                 coveredModule.moduleName = coveredModule.modulePath.filename().string();
+                if (options.jobs > 1) {
+                    coveredModule.symbols = &loadModuleSymbols(coveredModule.moduleName, coveredModule.modulePath);
+                }
                 testCoverage.emplace_back(std::move(coveredModule));
                 currentModule = &testCoverage.back();
                 cursorBelowModuleName = true;
@@ -260,7 +457,7 @@ SymbolResolver::analyzeCoverageFile(const fs::path &file) {
                 }
                 size_t offset = std::strtoul(line.substr(offsetStartPos, offsetEndPos - offsetStartPos).c_str(),
                                              nullptr, 16);
-                const CoveredSymbol *symbol = findSymbol(currentModule->moduleName, currentModule->modulePath, offset);
+                const CoveredSymbol *symbol = findSymbol(*currentModule, offset);
                 if (symbol != nullptr) {
                     currentModule->addSymbol(symbol);
                 }
@@ -274,8 +471,7 @@ SymbolResolver::analyzeCoverageFile(const fs::path &file) {
                     // We could also read all bytes at once, but the stdlib (or the OS) should pick a good buffer size
                     // for I/O read operations that reduces the number of OS context switches.
                     fread(&offset, sizeof(void *), 1, fp);
-                    const CoveredSymbol *symbol = findSymbol(currentModule->moduleName, currentModule->modulePath,
-                                                             (size_t) offset);
+                    const CoveredSymbol *symbol = findSymbol(*currentModule, (size_t) offset);
                     if (symbol != nullptr) {
                         currentModule->addSymbol(symbol);
                     }
@@ -318,13 +514,150 @@ SymbolResolver::walkCoverageFiles() {
         printf("DEBUG: Searching for coverage files with extension %s in %s\n", options.ext.c_str(),
                options.root.string().c_str());
 
+    std::vector<fs::path> files;
     for (const auto &path: fs::recursive_directory_iterator(options.root)) {
         if (path.path().extension() == options.ext &&
             path.path().filename() != DUMP_LOOKUP_FILE &&
-            path.path().filename() != FINAL_DUMP_FILE) {
-            analyzeCoverageFile(path.path());
+            !isFinalDumpFile(path.path().filename().string())) {
+            files.push_back(path.path());
         }
     }
+
+    size_t jobs = std::min(options.jobs, files.size());
+    if (jobs <= 1) {
+        for (const auto &file: files) {
+            analyzeCoverageFile(file);
+        }
+        return;
+    }
+
+    // Each worker takes the next file, and parses, resolves and rewrites it independently of all other files.
+    if (options.debug)
+        printf("DEBUG: Analyzing %zu coverage files with %zu jobs\n", files.size(), jobs);
+    std::atomic<size_t> nextFile = 0;
+    std::vector<std::thread> workers;
+    workers.reserve(jobs);
+    for (size_t i = 0; i < jobs; i++) {
+        workers.emplace_back([this, &files, &nextFile]() {
+            for (size_t index = nextFile++; index < files.size(); index = nextFile++) {
+                try {
+                    analyzeCoverageFile(files[index]);
+                } catch (std::exception &ex) {
+                    printf("ERROR: Failed to analyze coverage file %s: %s\n", files[index].string().c_str(),
+                           ex.what());
+                }
+            }
+        });
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void
+SymbolResolver::consumeStream() {
+    // Opening a FIFO blocks until the client has opened it for writing.
+    // We read frames until all writers have closed the FIFO.
+    FILE *stream = fopen(options.stream.string().c_str(), "rb");
+    if (stream == nullptr) {
+        printf("ERROR: Could not open coverage stream at %s\n", options.stream.string().c_str());
+        return;
+    }
+    if (options.debug)
+        printf("DEBUG: Reading coverage dumps from stream %s\n", options.stream.string().c_str());
+
+    fs::create_directories(options.root);
+
+    // Frames are read on this thread and resolved on others, such that the client is never blocked on a full FIFO
+    // while a previous dump is symbolized. The queue is unbounded, as it only holds the paths of pending files.
+    std::deque<fs::path> pendingFiles;
+    std::mutex pendingMutex;
+    std::condition_variable pendingChanged;
+    bool streamClosed = false;
+    std::vector<std::thread> workers;
+    size_t jobs = std::max<size_t>(options.jobs, 1);
+    workers.reserve(jobs);
+    for (size_t i = 0; i < jobs; i++) {
+        workers.emplace_back([&]() {
+            while (true) {
+                fs::path file;
+                {
+                    std::unique_lock<std::mutex> lock(pendingMutex);
+                    pendingChanged.wait(lock, [&]() { return streamClosed || !pendingFiles.empty(); });
+                    if (pendingFiles.empty()) {
+                        return;
+                    }
+                    file = std::move(pendingFiles.front());
+                    pendingFiles.pop_front();
+                }
+                try {
+                    analyzeCoverageFile(file);
+                } catch (std::exception &ex) {
+                    printf("ERROR: Failed to analyze coverage file %s: %s\n", file.string().c_str(), ex.what());
+                }
+            }
+        });
+    }
+
+    StreamFrameHeader header{};
+    std::vector<char> payload;
+    while (fread(&header, sizeof(header), 1, stream) == 1) {
+        if (header.magic != StreamFrameHeader::MAGIC || header.version != StreamFrameHeader::VERSION) {
+            printf("ERROR: Invalid frame in coverage stream, stopping\n");
+            break;
+        }
+        std::string dumpPrefix(header.prefixLength, '\0');
+        std::string dumpId(header.idLength, '\0');
+        payload.resize(header.payloadLength);
+        if ((header.prefixLength > 0 && fread(dumpPrefix.data(), header.prefixLength, 1, stream) != 1) ||
+            (header.idLength > 0 && fread(dumpId.data(), header.idLength, 1, stream) != 1) ||
+            (header.payloadLength > 0 && fread(payload.data(), header.payloadLength, 1, stream) != 1)) {
+            printf("ERROR: Truncated frame in coverage stream, stopping\n");
+            break;
+        }
+        if (dumpPrefix.find_first_of("/\\") != std::string::npos) {
+            printf("ERROR: Invalid dump prefix %s in coverage stream, skipping dump\n", dumpPrefix.c_str());
+            continue;
+        }
+
+        // We materialize the same files as the client would have written, such that the output is unchanged.
+        // The prefix keeps dumps of several clients (e.g., GoogleTest shards) apart.
+        std::string dumpName = dumpPrefix + std::to_string(header.dumpNumber);
+        fs::path file = options.root / (dumpName + options.ext);
+        FILE *fp = fopen(file.string().c_str(), "wb+");
+        if (fp == nullptr) {
+            printf("ERROR: Could not write coverage file %s, skipping dump\n", file.string().c_str());
+            continue;
+        }
+        bool written = fwrite(payload.data(), 1, payload.size(), fp) == payload.size();
+        if (fclose(fp) != 0 || !written) {
+            printf("ERROR: Could not write coverage file %s, skipping dump\n", file.string().c_str());
+            continue;
+        }
+        FILE *lookup = fopen((options.root / DUMP_LOOKUP_FILE).string().c_str(), "a");
+        if (lookup == nullptr) {
+            printf("ERROR: Could not append to %s\n", DUMP_LOOKUP_FILE);
+        } else {
+            fprintf(lookup, "%s;%s\n", dumpName.c_str(), dumpId.c_str());
+            fclose(lookup);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pendingFiles.push_back(std::move(file));
+        }
+        pendingChanged.notify_one();
+    }
+    fclose(stream);
+
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        streamClosed = true;
+    }
+    pendingChanged.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
 }
 
 void
@@ -337,7 +670,11 @@ SymbolResolver::run() {
     auto before = high_resolution_clock::now();
 
     initSymbolServer();
-    walkCoverageFiles();
+    if (options.stream.empty()) {
+        walkCoverageFiles();
+    } else {
+        consumeStream();
+    }
     cleanupSymbolServer();
 
     auto after = high_resolution_clock::now();
@@ -345,5 +682,5 @@ SymbolResolver::run() {
     auto totalDuration = duration_cast<milliseconds>(after - before);
     printf("INFO: Took %ldms to finish\n", totalDuration.count());
     if (options.debug)
-        printf("DEBUG: Counters at query=%zu, match=%zu\n", symbolQueryCounter, symbolMatchCounter);
+        printf("DEBUG: Counters at query=%zu, match=%zu\n", symbolQueryCounter.load(), symbolMatchCounter.load());
 }
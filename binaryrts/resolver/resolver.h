@@ -1,21 +1,25 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <filesystem>
 #include <vector>
 #include <memory>
 #include <optional>
 #include <regex>
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
+#include <deque>
 
 namespace fs = std::filesystem;
 
 // A covered symbol contains detailed resolved symbol information.
 struct CoveredSymbol {
 
+    // Offsets without a symbol are not cached as symbols (see SymbolCache::ModuleSymbols::unresolvedOffsets).
     enum class SymbolStatus {
-        UNRESOLVED,
-        NOT_FOUND,
         EXCLUDED,
         RESOLVED
     };
@@ -27,26 +31,51 @@ struct CoveredSymbol {
     size_t start;
     size_t end;
     SymbolStatus status;
-
-    [[nodiscard]] inline bool isSameSymbol(size_t otherOffset) const {
-        return otherOffset >= start && otherOffset <= end;
-    }
-
-    [[nodiscard]] inline bool isSameLine(const CoveredSymbol &other) const {
-        return line == other.line && file == other.file;
-    }
 };
 
 // A symbol cache keeps track of all already resolved symbols across modules and provides a fast lookup cache.
 struct SymbolCache {
 
-    // A symbol map keeps track of symbols' offsets and the corresponding resolved symbol information. 
-    using SymbolMap = std::unordered_map<uint64_t, std::unique_ptr<CoveredSymbol>>;
+    // A symbol interval maps the offsets [start, end) of a function to its resolved symbol information.
+    struct SymbolInterval {
+        size_t start;
+        size_t end;
+        const CoveredSymbol *symbol;
+    };
+
+    // The symbols of a module are kept in a sorted array of non-overlapping intervals that is binary searched,
+    // such that every covered offset (e.g., of a basic block) resolves to its function without allocations.
+    struct ModuleSymbols {
+        std::deque<CoveredSymbol> symbols; // stable storage, the coverage of tests points into it
+        std::vector<SymbolInterval> intervals; // sorted by start
+        // Recently resolved intervals (sorted by start), which are merged into intervals in batches, such that
+        // resolving n functions one by one does not move O(n) intervals per function.
+        std::vector<SymbolInterval> pendingIntervals;
+        std::unordered_set<uint64_t> unresolvedOffsets; // offsets that drsyms could not resolve
+        bool isComplete = false; // all symbols of the module are known (i.e., loaded from disk)
+    };
 
     // A module map keeps track of modules (by name) and their corresponding symbols.
-    using ModuleMap = std::unordered_map<std::string, SymbolMap>;
+    using ModuleMap = std::unordered_map<std::string, ModuleSymbols>;
 
-    CoveredSymbol *findSymbol(const std::string &moduleName, size_t offset);
+    // Returns the symbol that contains offset (which may be EXCLUDED), or nullptr.
+    // isKnown is false if the offset still has to be resolved. Read-only, hence can be called concurrently.
+    const CoveredSymbol *findSymbol(const std::string &moduleName, size_t offset, bool &isKnown) const;
+
+    static const CoveredSymbol *findSymbol(const ModuleSymbols &module, size_t offset, bool &isKnown);
+
+    // Returns the symbols of a module, or nullptr if the module is unknown.
+    const ModuleSymbols *findModule(const std::string &moduleName) const;
+
+    // Adds a resolved symbol that contains offset, its interval is clipped to not overlap known symbols.
+    const CoveredSymbol *addSymbol(const std::string &moduleName, size_t offset, CoveredSymbol &&symbol);
+
+    // Adds all symbols of a module at once (in any order), the module is complete afterwards.
+    const ModuleSymbols &addModuleSymbols(const std::string &moduleName, std::deque<CoveredSymbol> &&symbols);
+
+    void addUnresolvedOffset(const std::string &moduleName, size_t offset) {
+        modules[moduleName].unresolvedOffsets.insert(offset);
+    }
 
     bool hasLoadedModule(const std::string &moduleName) {
         return modules.find(moduleName) != modules.end();
@@ -56,8 +85,6 @@ struct SymbolCache {
 
 private:
     ModuleMap modules;
-    std::optional<std::pair<std::string, SymbolMap *>> lastQueriedModule;
-    std::optional<std::pair<uint64_t, CoveredSymbol *>> lastQueriedSymbol;
 };
 
 // A module coverage object is simply a collection of covered symbols (read-only) as returned from the symbol cache.
@@ -65,35 +92,63 @@ struct ModuleCoverage {
     std::string moduleName;
     fs::path modulePath;
     std::vector<const CoveredSymbol *> coveredSymbols;
+    // With multiple jobs, the complete symbols of the module, which are looked up without locking.
+    const SymbolCache::ModuleSymbols *symbols = nullptr;
 
+    // Adds a symbol unless the same symbol or another symbol on the same source line has already been added.
+    // Symbols are unique per function in the symbol cache, hence duplicates are found by pointer in O(1).
     bool addSymbol(const CoveredSymbol *symbol) {
-        bool isSameAsLastSymbol =
-                lastSymbol && (lastSymbol->isSameSymbol(symbol->offset) || lastSymbol->isSameLine(*symbol));
+        if (symbol == lastSymbol) {
+            return false;
+        }
         lastSymbol = symbol;
-        if (isSameAsLastSymbol) {
+        if (!addedSymbols.insert(symbol).second) {
             return false;
         }
-        for (auto coveredSymbol: coveredSymbols) {
-            if (coveredSymbol->isSameSymbol(symbol->offset) || coveredSymbol->isSameLine(*symbol)) {
-                return false;
-            }
+        if (!coveredLines.emplace(symbol->file, symbol->line).second) {
+            return false;
         }
         coveredSymbols.push_back(symbol);
         return true;
     }
 
 private:
+    struct SourceLineHash {
+        size_t operator()(const std::pair<std::string_view, uint64_t> &line) const {
+            return std::hash<std::string_view>{}(line.first) ^ (std::hash<uint64_t>{}(line.second) * 31);
+        }
+    };
+
     const CoveredSymbol *lastSymbol = nullptr;
+    std::unordered_set<const CoveredSymbol *> addedSymbols;
+    // Views into the file names of symbols, which are owned by the symbol cache.
+    std::unordered_set<std::pair<std::string_view, uint64_t>, SourceLineHash> coveredLines;
 };
 
 // A test coverage object aggregates the coverage across all modules for a single test (i.e., a single coverage log file).
 using TestCoverage = std::vector<ModuleCoverage>;
 
+// Header of a single dump frame, as streamed by the client with -stream (see client/stream.h, keep in sync).
+struct StreamFrameHeader {
+    static constexpr uint32_t MAGIC = 0x53545242; // "BRTS"
+    static constexpr uint32_t VERSION = 2;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dumpNumber;
+    uint32_t prefixLength;
+    uint32_t idLength;
+    uint32_t reserved;
+    uint64_t payloadLength;
+};
+
 // Resolver CLI options.
 struct ResolverOptions {
     std::string ext;
     std::string regex;
     fs::path root;
+    fs::path stream; // If set, dumps are read from this FIFO (and written to root), instead of walking root.
+    size_t jobs;     // Number of worker threads that analyze coverage files when walking root.
     bool debug;
     bool resolveSymbols;
 };
@@ -109,23 +164,34 @@ public:
 
     void run();
 
-    const CoveredSymbol *findSymbol(const std::string &moduleName, const fs::path &modulePath, size_t offset);
+    const CoveredSymbol *findSymbol(const ModuleCoverage &module, size_t offset);
 
 private:
+    const CoveredSymbol *resolveSymbol(const std::string &moduleName, const fs::path &modulePath, size_t offset);
+
+    const SymbolCache::ModuleSymbols &loadModuleSymbols(const std::string &moduleName, const fs::path &modulePath);
+
+    std::deque<CoveredSymbol> enumerateModuleSymbols(const fs::path &modulePath);
+
     void initSymbolServer();
 
     void cleanupSymbolServer();
 
     void walkCoverageFiles();
 
+    void consumeStream();
+
     void analyzeCoverageFile(const fs::path &file);
 
     static void writeCoverageToFile(const fs::path &file, const TestCoverage &coverage);
 
     SymbolCache cache;
+    // With multiple jobs, all symbols of a module are loaded once under this lock when a coverage file first
+    // refers to it; afterwards, the module is complete and never modified, hence offsets are looked up lock-free.
+    std::mutex cacheMutex;
     const ResolverOptions &options;
     std::optional<std::regex> regex;
     bool isInitialized;
-    size_t symbolMatchCounter = 0;
-    size_t symbolQueryCounter = 0;
+    std::atomic<size_t> symbolMatchCounter = 0;
+    std::atomic<size_t> symbolQueryCounter = 0;
 };
\ No newline at end of file
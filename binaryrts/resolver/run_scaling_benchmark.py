@@ -0,0 +1,129 @@
+"""
+This script measures how `binary_rts_resolver -jobs N` scales with the number of worker threads. It writes synthetic
+text dumps (as the client does with `-text_dump`) that cover offsets of a real module, runs the resolver on fresh
+copies of them for each number of jobs, and reports the wall times and speedups as JSON.
+"""
+import argparse
+import json
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+from typing import Dict, List
+
+
+def parse_arguments() -> argparse.Namespace:
+    """
+    Define and parse program arguments.
+
+    :return: arguments captured in object.
+    """
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--resolver", required=True, help="Path to binary_rts_resolver.")
+    parser.add_argument("--module", required=True, help="Module (with debug information) covered by the dumps.")
+    parser.add_argument("--files", type=int, default=10000, help="Number of coverage files (i.e., tests).")
+    parser.add_argument("--offsets", type=int, default=500, help="Covered offsets per file.")
+    parser.add_argument(
+        "--unique-offsets",
+        type=int,
+        default=20000,
+        help="Number of distinct offsets across all files (controls the symbol cache hit rate).",
+    )
+    parser.add_argument("--jobs", default=f"1,2,4,8,{os.cpu_count()}", help="Comma-separated numbers of jobs.")
+    parser.add_argument("--repetitions", "-r", type=int, default=3, help="Runs per number of jobs.")
+    parser.add_argument("--regex", default=".*", help="Source file regex passed to the resolver.")
+    parser.add_argument("--seed", type=int, default=42)
+    parser.add_argument("--output", "-o", help="Output JSON file (default: stdout).")
+    return parser.parse_args()
+
+
+def get_function_offsets(module: Path) -> List[int]:
+    """
+    Offsets of all functions of the module (via `nm`), or every 16th byte of the module if `nm` is not available.
+    """
+    try:
+        output: str = subprocess.run(
+            ["nm", "--defined-only", str(module)], capture_output=True, text=True, check=True
+        ).stdout
+        offsets: List[int] = [
+            int(line.split()[0], 16)
+            for line in output.splitlines()
+            if len(line.split()) == 3 and line.split()[1] in "tT"
+        ]
+        if len(offsets) > 0:
+            return offsets
+    except (OSError, subprocess.CalledProcessError, ValueError):
+        pass
+    return list(range(0, module.stat().st_size, 16))
+
+
+def write_dumps(root: Path, module: Path, args: argparse.Namespace) -> None:
+    rng: random.Random = random.Random(args.seed)
+    functions: List[int] = get_function_offsets(module)
+    # Offsets inside functions, such that several offsets resolve to the same function.
+    pool: List[int] = [rng.choice(functions) + rng.randrange(0, 64) for _ in range(args.unique_offsets)]
+    module_dir: Path = root / "module"
+    module_dir.mkdir(parents=True)
+    lookup: List[str] = []
+    for i in range(1, args.files + 1):
+        lines: List[str] = [f"{module.name}\t{module}"]
+        lines += [f"\t+0x{offset:x}" for offset in rng.sample(pool, min(args.offsets, len(pool)))]
+        (module_dir / f"{i}.log").write_text("\n".join(lines) + "\n")
+        lookup.append(f"{i};Suite.Test{i}___PASSED")
+    (module_dir / "dump-lookup.log").write_text("\n".join(lookup) + "\n")
+
+
+def main():
+    # Parse arguments
+    args = parse_arguments()
+
+    module: Path = Path(args.module).resolve()
+    work_dir: Path = Path(tempfile.mkdtemp(prefix="binaryrts-resolver-bench-"))
+    try:
+        template: Path = work_dir / "template"
+        write_dumps(template, module, args)
+
+        results: Dict = {
+            "module": str(module),
+            "files": args.files,
+            "offsets": args.offsets,
+            "unique_offsets": args.unique_offsets,
+            "cpu_count": os.cpu_count(),
+            "jobs": {},
+        }
+        for jobs in [int(jobs) for jobs in args.jobs.split(",")]:
+            wall_s: List[float] = []
+            for _ in range(args.repetitions):
+                # The resolver rewrites the dumps in place, hence each run needs a fresh copy.
+                root: Path = work_dir / "run"
+                shutil.rmtree(root, ignore_errors=True)
+                shutil.copytree(template, root)
+                start: float = time.perf_counter()
+                subprocess.run(
+                    [args.resolver, "-root", str(root), "-regex", args.regex, "-jobs", str(jobs)],
+                    check=True,
+                    stdout=subprocess.DEVNULL,
+                )
+                wall_s.append(time.perf_counter() - start)
+            results["jobs"][jobs] = {"wall_s": wall_s, "wall_s_min": min(wall_s)}
+            print(f"jobs={jobs}: {min(wall_s):.3f}s", file=sys.stderr)
+
+        baseline: float = results["jobs"][min(results["jobs"])]["wall_s_min"]
+        for result in results["jobs"].values():
+            result["speedup"] = baseline / result["wall_s_min"] if result["wall_s_min"] > 0 else None
+    finally:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+    output: str = json.dumps(results, indent=2)
+    if args.output:
+        Path(args.output).write_text(output)
+    else:
+        print(output)
+
+
+if __name__ == "__main__":
+    main()
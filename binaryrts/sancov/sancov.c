@@ -0,0 +1,489 @@
+/*
+ * SanitizerCoverage callbacks that record BinaryRTS coverage without dynamic binary instrumentation.
+ * See sancov.h for usage and the dump format.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "sancov.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <link.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* The callbacks must not be instrumented themselves, in case the library is built with global coverage flags. */
+#if defined(__clang__)
+#define NO_COVERAGE __attribute__((no_sanitize("coverage")))
+#elif defined(__GNUC__) && __GNUC__ >= 12
+#define NO_COVERAGE __attribute__((no_sanitize_coverage))
+#else
+#define NO_COVERAGE
+#endif
+
+#define MAX_MODULES 1024
+#define MAX_GUARDS (1U << 26) /* Virtual size of the guard tables, pages are only committed when used. */
+#define MAX_DUMP_PREFIX 64
+#define MAXIMUM_FILENAME (MAX_DUMP_PREFIX + 32) /* Dump prefix, dump number (or coverage.log) and extension. */
+#define MAX_PUBLISH_WAIT (1U << 20) /* Yields until a reserved hit slot is given up (e.g., after fork). */
+#define DUMP_LOOKUP_FILE "dump-lookup.log"
+#define DEFAULT_COVERAGE_LOG "coverage.log"
+
+typedef struct _module_t {
+    char path[PATH_MAX];
+    const char *name; /* File name within path. */
+    uintptr_t base;   /* Start of the lowest mapped segment, offsets are relative to it. */
+    /* Identify the module in the link map, such that its memory is only accessed while it is loaded. */
+    uintptr_t load_addr;
+    char *link_name;
+    int unloaded;
+    /* trace-pc-guard: guards [first_guard, end_guard) of the global guard tables. */
+    uint32_t first_guard;
+    uint32_t end_guard;
+    /* inline-8bit-counters: one counter and pc-table entry (PC, flags) per block. */
+    uint8_t *counters;
+    const uintptr_t *pcs;
+    uint8_t *ever_covered;
+    size_t num_counters;
+} module_t;
+
+typedef struct _module_query_t {
+    uintptr_t addr;
+    module_t *module;
+    int found;
+} module_query_t;
+
+typedef struct _module_visit_t {
+    module_t *module;
+    void (*visit)(module_t *module, void *data);
+    void *data;
+    int found;
+} module_visit_t;
+
+/* Coverage of one module that is collected while the module is guaranteed to be loaded. */
+typedef struct _module_reset_t {
+    int final;
+    const uint32_t *guards; /* Guards of the module hit since the last dump, to re-enable. */
+    size_t num_guards;
+    uintptr_t *offsets;     /* Covered counters. */
+    uint8_t *counts;
+    size_t count;
+} module_reset_t;
+
+static module_t modules[MAX_MODULES];
+static uint32_t num_modules;
+static pthread_mutex_t sancov_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Guards hold a global index (0 = disabled). On its first hit in a test, a guard is disabled and its index is
+ * appended to the active one of two hit lists, such that dumps only visit the hit guards and re-enable them.
+ * Appending reserves a slot and then publishes the index into it. hit_state holds the dump generation (whose
+ * lowest bit selects the active list) in its upper and the number of reserved slots in its lower 32 bits, hence a
+ * dump atomically switches to the other list, which was cleared by the previous dump, and then waits for the
+ * reserved slots of its list to be published, without any slot being reused while it reads them.
+ */
+static uint32_t **guard_ptrs;
+static uintptr_t *guard_pcs; /* PC of each guard, non-zero once it was hit in any test. */
+static uint32_t *hits[2];
+static uint32_t num_guards = 1;
+static uint64_t hit_state;
+
+static int initialized;
+static int text_dump;
+static const char *logdir = ".";
+static char dump_prefix[MAX_DUMP_PREFIX]; /* shard<N>_ for GoogleTest shards, which usually share the log directory. */
+static int dump_count;
+
+static void NO_COVERAGE
+write_final_coverage(void);
+
+static void * NO_COVERAGE
+map_table(size_t size) {
+    void *table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return table == MAP_FAILED ? NULL : table;
+}
+
+/* Must be called with sancov_lock held. */
+static int NO_COVERAGE
+init_sancov(void) {
+    if (initialized)
+        return initialized > 0;
+    guard_ptrs = map_table(MAX_GUARDS * sizeof(*guard_ptrs));
+    guard_pcs = map_table(MAX_GUARDS * sizeof(*guard_pcs));
+    hits[0] = map_table(MAX_GUARDS * sizeof(*hits[0]));
+    hits[1] = map_table(MAX_GUARDS * sizeof(*hits[1]));
+    if (guard_ptrs == NULL || guard_pcs == NULL || hits[0] == NULL || hits[1] == NULL) {
+        fprintf(stderr, "BinaryRTS sancov: failed to map guard tables, coverage is disabled\n");
+        initialized = -1;
+        return 0;
+    }
+    const char *env = getenv("BINARY_RTS_LOGDIR");
+    if (env != NULL && env[0] != '\0')
+        logdir = env;
+    env = getenv("BINARY_RTS_TEXT_DUMP");
+    text_dump = env != NULL && strcmp(env, "1") == 0;
+    const char *total_shards = getenv("GTEST_TOTAL_SHARDS");
+    const char *shard_index = getenv("GTEST_SHARD_INDEX");
+    if (total_shards != NULL && shard_index != NULL && atoi(total_shards) > 1)
+        snprintf(dump_prefix, sizeof(dump_prefix), "shard%d_", atoi(shard_index));
+    atexit(write_final_coverage);
+    initialized = 1;
+    return 1;
+}
+
+static int NO_COVERAGE
+find_module_callback(struct dl_phdr_info *info, size_t size, void *data) {
+    module_query_t *query = (module_query_t *) data;
+    uintptr_t low = UINTPTR_MAX;
+    int contains = 0;
+    int i;
+
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type != PT_LOAD)
+            continue;
+        uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+        if (start < low)
+            low = start;
+        if (query->addr >= start && query->addr < start + phdr->p_memsz)
+            contains = 1;
+    }
+    if (!contains)
+        return 0;
+
+    module_t *module = query->module;
+    module->base = low & ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1);
+    module->load_addr = info->dlpi_addr;
+    module->link_name = strdup(info->dlpi_name == NULL ? "" : info->dlpi_name);
+    if (module->link_name == NULL)
+        return 0;
+    if (info->dlpi_name == NULL || info->dlpi_name[0] == '\0') {
+        /* The main executable has no name in the link map. */
+        ssize_t len = readlink("/proc/self/exe", module->path, sizeof(module->path) - 1);
+        module->path[len < 0 ? 0 : len] = '\0';
+    } else if (realpath(info->dlpi_name, module->path) == NULL) {
+        snprintf(module->path, sizeof(module->path), "%s", info->dlpi_name);
+    }
+    const char *sep = strrchr(module->path, '/');
+    module->name = sep == NULL ? module->path : sep + 1;
+    query->found = 1;
+    return 1;
+}
+
+/* Registers the module that contains `addr` (e.g., its guards). Must be called with sancov_lock held. */
+static module_t * NO_COVERAGE
+register_module(const void *addr) {
+    if (num_modules == MAX_MODULES) {
+        fprintf(stderr, "BinaryRTS sancov: more than %d instrumented modules, skipping the rest\n", MAX_MODULES);
+        return NULL;
+    }
+    module_t *module = &modules[num_modules];
+    memset(module, 0, sizeof(*module));
+    module_query_t query = { (uintptr_t) addr, module, 0 };
+    dl_iterate_phdr(find_module_callback, &query);
+    if (!query.found) {
+        fprintf(stderr, "BinaryRTS sancov: no module found for %p, skipping it\n", addr);
+        return NULL;
+    }
+    num_modules++;
+    return module;
+}
+
+void NO_COVERAGE
+__sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop) {
+    /* Called once per module constructor, guards of modules with multiple constructors are already set. */
+    if (start == stop || *start != 0)
+        return;
+
+    pthread_mutex_lock(&sancov_lock);
+    if (!init_sancov()) {
+        pthread_mutex_unlock(&sancov_lock);
+        return;
+    }
+    size_t count = (size_t) (stop - start);
+    if (count >= MAX_GUARDS - num_guards) {
+        fprintf(stderr, "BinaryRTS sancov: more than %u guards, skipping module\n", MAX_GUARDS);
+        pthread_mutex_unlock(&sancov_lock);
+        return;
+    }
+    module_t *module = register_module(start);
+    if (module != NULL) {
+        uint32_t *guard;
+        module->first_guard = num_guards;
+        for (guard = start; guard < stop; guard++) {
+            guard_ptrs[num_guards] = guard;
+            *guard = num_guards++;
+        }
+        module->end_guard = num_guards;
+    }
+    pthread_mutex_unlock(&sancov_lock);
+}
+
+void NO_COVERAGE
+__sanitizer_cov_trace_pc_guard(uint32_t *guard) {
+    if (*guard == 0)
+        return;
+    /* Only one thread wins the guard, hence each index is appended at most once per test. */
+    uint32_t index = __atomic_exchange_n(guard, 0, __ATOMIC_RELAXED);
+    if (index == 0)
+        return;
+    /* Return address minus one is within the call instruction of the covered block. */
+    guard_pcs[index] = (uintptr_t) __builtin_return_address(0) - 1;
+    uint64_t state = __atomic_fetch_add(&hit_state, 1, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&hits[(state >> 32) & 1][(uint32_t) state], index, __ATOMIC_RELEASE);
+}
+
+void NO_COVERAGE
+__sanitizer_cov_8bit_counters_init(uint8_t *start, uint8_t *stop) {
+    if (start == stop)
+        return;
+
+    pthread_mutex_lock(&sancov_lock);
+    uint32_t i;
+    for (i = 0; i < num_modules; i++) {
+        if (modules[i].counters == start) {
+            pthread_mutex_unlock(&sancov_lock);
+            return;
+        }
+    }
+    module_t *module = init_sancov() ? register_module(start) : NULL;
+    if (module != NULL) {
+        module->counters = start;
+        module->num_counters = (size_t) (stop - start);
+        module->ever_covered = calloc(module->num_counters, 1);
+        if (module->ever_covered == NULL)
+            num_modules--;
+    }
+    pthread_mutex_unlock(&sancov_lock);
+}
+
+void NO_COVERAGE
+__sanitizer_cov_pcs_init(const uintptr_t *pcs_beg, const uintptr_t *pcs_end) {
+    /* Called right after __sanitizer_cov_8bit_counters_init of the same module. */
+    size_t count = (size_t) (pcs_end - pcs_beg) / 2;
+    pthread_mutex_lock(&sancov_lock);
+    uint32_t i = num_modules;
+    while (i > 0) {
+        module_t *module = &modules[--i];
+        if (module->counters != NULL && module->pcs == NULL && module->num_counters == count) {
+            module->pcs = pcs_beg;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sancov_lock);
+}
+
+static FILE * NO_COVERAGE
+open_log_file(const char *fname, const char *mode) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", logdir, fname) >= (int) sizeof(path)) {
+        fprintf(stderr, "BinaryRTS sancov: path of %s in %s is too long\n", fname, logdir);
+        return NULL;
+    }
+    FILE *file = fopen(path, mode);
+    if (file == NULL)
+        fprintf(stderr, "BinaryRTS sancov: failed to open %s\n", path);
+    return file;
+}
+
+/* Writes one module section in the format of the DynamoRIO client. */
+static void NO_COVERAGE
+write_module(FILE *file, const module_t *module, const uintptr_t *offsets, const uint8_t *counts, size_t count) {
+    size_t i;
+    if (count == 0)
+        return;
+    fprintf(file, "%s\t%s\n", module->name, module->path);
+    if (text_dump) {
+        for (i = 0; i < count; i++)
+            fprintf(file, "\t+0x%" PRIxPTR "\t%u\n", offsets[i], counts != NULL ? counts[i] : 1U);
+    } else {
+        fprintf(file, "\tBBs: %zu\n", count);
+        fwrite(offsets, sizeof(*offsets), count, file);
+        fputc('\n', file);
+    }
+}
+
+static int NO_COVERAGE
+visit_module_callback(struct dl_phdr_info *info, size_t size, void *data) {
+    module_visit_t *visit = (module_visit_t *) data;
+    module_t *module = visit->module;
+    if (info->dlpi_addr != module->load_addr ||
+        strcmp(info->dlpi_name == NULL ? "" : info->dlpi_name, module->link_name) != 0)
+        return 0;
+    /* The loader cannot unmap the module while its entry is visited. */
+    visit->visit(module, visit->data);
+    visit->found = 1;
+    return 1;
+}
+
+/*
+ * Calls `visit` for the module if it is still loaded, otherwise marks it as unloaded (e.g., by dlclose), such that
+ * its guards and counters are never accessed again. Returns whether `visit` was called.
+ */
+static int NO_COVERAGE
+visit_loaded_module(module_t *module, void (*visit)(module_t *, void *), void *data) {
+    if (module->unloaded)
+        return 0;
+    module_visit_t query = { module, visit, data, 0 };
+    dl_iterate_phdr(visit_module_callback, &query);
+    module->unloaded = !query.found;
+    return query.found;
+}
+
+/* Re-enables the guards hit since the last dump, and collects (and unless final, resets) the counters. */
+static void NO_COVERAGE
+reset_module(module_t *module, void *data) {
+    module_reset_t *reset = (module_reset_t *) data;
+    size_t i;
+    for (i = 0; i < reset->num_guards; i++)
+        __atomic_store_n(guard_ptrs[reset->guards[i]], reset->guards[i], __ATOMIC_RELAXED);
+
+    if (module->counters == NULL || module->pcs == NULL)
+        return;
+    for (i = 0; i < module->num_counters; i++) {
+        uint8_t hit_count = module->counters[i];
+        if (reset->final ? (hit_count != 0 || module->ever_covered[i]) : hit_count != 0) {
+            reset->offsets[reset->count] = module->pcs[2 * i] - module->base;
+            reset->counts[reset->count++] = hit_count != 0 ? hit_count : 1;
+        }
+        if (!reset->final && hit_count != 0) {
+            module->ever_covered[i] = 1;
+            module->counters[i] = 0;
+        }
+    }
+}
+
+static int NO_COVERAGE
+compare_guards(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Writes the coverage since the last dump and resets it, or with `final`, everything covered during the run.
+ * Must be called with sancov_lock held.
+ */
+static void NO_COVERAGE
+write_coverage(FILE *file, int final) {
+    uint32_t *covered = NULL;
+    size_t num_covered = 0;
+    size_t max_offsets = 0;
+    uint32_t i;
+
+    if (!final) {
+        /* Guards hit since the last dump, in ascending order (i.e., grouped by module). */
+        uint64_t state = __atomic_load_n(&hit_state, __ATOMIC_RELAXED);
+        state = __atomic_exchange_n(&hit_state, ((state >> 32) + 1) << 32, __ATOMIC_ACQ_REL);
+        uint32_t *list = hits[(state >> 32) & 1];
+        uint32_t count = (uint32_t) state;
+        covered = malloc((count + 1) * sizeof(*covered));
+        if (covered == NULL)
+            return;
+        for (i = 0; i < count; i++) {
+            /* A thread that reserved the slot may not have published its guard yet, which would otherwise stay
+             * disabled forever. Slots are only reserved by running threads, unless this process was forked in
+             * between, hence waiting is bounded. */
+            uint32_t guard;
+            uint32_t waited = 0;
+            while ((guard = __atomic_load_n(&list[i], __ATOMIC_ACQUIRE)) == 0 && waited++ < MAX_PUBLISH_WAIT)
+                sched_yield();
+            if (guard != 0)
+                covered[num_covered++] = guard;
+            __atomic_store_n(&list[i], 0, __ATOMIC_RELAXED);
+        }
+        qsort(covered, num_covered, sizeof(*covered), compare_guards);
+    }
+    for (i = 0; i < num_modules; i++) {
+        size_t size = modules[i].end_guard - modules[i].first_guard + modules[i].num_counters;
+        if (size > max_offsets)
+            max_offsets = size;
+    }
+    uintptr_t *offsets = malloc((max_offsets + 1) * sizeof(*offsets));
+    uint8_t *counts = malloc(max_offsets + 1);
+    if (offsets == NULL || counts == NULL) {
+        free(covered);
+        free(offsets);
+        free(counts);
+        return;
+    }
+
+    size_t next = 0;
+    for (i = 0; i < num_modules; i++) {
+        module_t *module = &modules[i];
+        module_reset_t reset = { final, covered + next, 0, offsets, counts, 0 };
+        size_t count = 0;
+        uint32_t guard;
+        if (final) {
+            for (guard = module->first_guard; guard < module->end_guard; guard++) {
+                if (guard_pcs[guard] != 0)
+                    offsets[count++] = guard_pcs[guard] - module->base;
+            }
+        } else {
+            for (; next < num_covered && covered[next] < module->end_guard; next++)
+                offsets[count++] = guard_pcs[covered[next]] - module->base;
+            reset.num_guards = count;
+        }
+        write_module(file, module, offsets, NULL, count);
+
+        /* Guards of the next test are re-enabled and counters read in the module's memory. */
+        if (reset.num_guards > 0 || module->counters != NULL) {
+            if (visit_loaded_module(module, reset_module, &reset))
+                write_module(file, module, offsets, counts, reset.count);
+        }
+    }
+
+    free(covered);
+    free(offsets);
+    free(counts);
+}
+
+void NO_COVERAGE
+binary_rts_sancov_dump(const char *dump_id) {
+    pthread_mutex_lock(&sancov_lock);
+    if (initialized <= 0) {
+        pthread_mutex_unlock(&sancov_lock);
+        return;
+    }
+    dump_count++;
+    char fname[MAXIMUM_FILENAME];
+    if (snprintf(fname, sizeof(fname), "%s%d.log", dump_prefix, dump_count) >= (int) sizeof(fname)) {
+        fprintf(stderr, "BinaryRTS sancov: dump file name of %s is too long\n", dump_id);
+        pthread_mutex_unlock(&sancov_lock);
+        return;
+    }
+    FILE *file = open_log_file(fname, "wb");
+    if (file != NULL) {
+        write_coverage(file, 0);
+        fclose(file);
+    }
+    FILE *lookup_file = open_log_file(DUMP_LOOKUP_FILE, "a");
+    if (lookup_file != NULL) {
+        fprintf(lookup_file, "%s%d;%s\n", dump_prefix, dump_count, dump_id);
+        fclose(lookup_file);
+    }
+    pthread_mutex_unlock(&sancov_lock);
+}
+
+static void NO_COVERAGE
+write_final_coverage(void) {
+    pthread_mutex_lock(&sancov_lock);
+    char fname[MAXIMUM_FILENAME];
+    FILE *file = NULL;
+    if (snprintf(fname, sizeof(fname), "%s" DEFAULT_COVERAGE_LOG, dump_prefix) < (int) sizeof(fname))
+        file = open_log_file(fname, "wb");
+    if (file != NULL) {
+        write_coverage(file, 1);
+        fclose(file);
+    }
+    pthread_mutex_unlock(&sancov_lock);
+}
@@ -0,0 +1,38 @@
+#ifndef _BINARYRTS_SANCOV_H_
+#define _BINARYRTS_SANCOV_H_
+
+/*
+ * Compiler-instrumentation coverage backend of BinaryRTS, an alternative to the DynamoRIO client.
+ *
+ * Implements the SanitizerCoverage callbacks of Clang for
+ *   -fsanitize-coverage=trace-pc-guard                (guards are disabled after their first hit in a test), or
+ *   -fsanitize-coverage=inline-8bit-counters,pc-table (counters are scanned on each dump),
+ * and writes per-test dumps in the module/offset format of the DynamoRIO client (`N.log`, `dump-lookup.log`,
+ * and `coverage.log` with all offsets covered during the run on exit), such that `binary_rts_resolver` and the
+ * CLI can consume them unchanged. Offsets are relative to the lowest mapped segment of each module.
+ *
+ * Dumps are triggered by BinaryRTSTestListener (the listener calls binary_rts_sancov_dump if this library is
+ * linked) and configured by environment variables:
+ *   BINARY_RTS_LOGDIR     output directory of dumps (default: current working directory)
+ *   BINARY_RTS_TEXT_DUMP  if set to 1, write text instead of binary dumps (as `-text_dump` of the client)
+ * With GoogleTest sharding (GTEST_TOTAL_SHARDS > 1), dump files and lookup entries are prefixed with `shard<N>_`.
+ *
+ * Only the instrumented code itself must be compiled with -fsanitize-coverage, not this library.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Writes the coverage since the last dump to the next `N.log` file of the log directory, appends `N;dump_id`
+ * to `dump-lookup.log`, and resets the coverage. Thread-safe.
+ */
+void
+binary_rts_sancov_dump(const char *dump_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BINARYRTS_SANCOV_H_ */
@@ -12,6 +12,33 @@
  *   accumulated function coverage to per-test log files. This integrates
  *   with GoogleTest via PinTestListener.
  *
+ * Basic block mode (-runtime_dump -bbl):
+ *   Records covered basic blocks instead of functions and writes per-test
+ *   dumps in the format of the BinaryRTS DynamoRIO client (binary by default,
+ *   text with -text_dump), such that binary_rts_resolver can consume them.
+ *
+ * Probe mode (-runtime_dump -probe):
+ *   Runs the program natively under PIN_StartProgramProbed and records
+ *   function coverage through probes at routine entries, which is much
+ *   cheaper than JIT mode but only works at function granularity.
+ *
+ * Call trace mode (-all 1):
+ *   Records every call as a compact binary record through per-thread Pin
+ *   trace buffers, which a writer thread appends to <output>.calls. The text
+ *   output then contains the function table, functrace_decode turns both
+ *   into a readable call trace.
+ *
+ * Edge mode (-runtime_dump -edges):
+ *   Additionally records (caller, callee) function pairs per test, using
+ *   per-thread shadow call stacks and a fixed-size edge table, and writes
+ *   them to an N.edges file next to each N.log dump.
+ *
+ * Child processes (-runtime_dump -follow_child):
+ *   Child processes publish their coverage into a shared memory region
+ *   created by the first (owner) process, which merges it into the dump of
+ *   the test that is running. Children that dump per test themselves, or
+ *   whose owner collects no child coverage, write per-process dump files.
+ *
  * Usage:
  *   pin -t obj-intel64/functrace.so -- ./your_program
  *   pin -t obj-intel64/functrace.so -runtime_dump -logdir unittests -- ./unittests
@@ -20,12 +47,26 @@
  */
 
 #include "pin.H"
+#include "functrace_calls.h"
+#include "filter.h"
+#include <cstddef>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <string>
 #include <unordered_set>
+#include <deque>
+#include <vector>
 #include <unordered_map>
+#include <map>
+#include <set>
 #include <mutex>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -65,11 +106,35 @@ KNOB<std::string> KnobModulesFile(KNOB_MODE_WRITEONCE, "pintool",
 KNOB<BOOL> KnobFollowChild(KNOB_MODE_WRITEONCE, "pintool",
     "follow_child", "0", "Follow child processes (fork/exec)");
 
+KNOB<std::string> KnobSharedCoverage(KNOB_MODE_WRITEONCE, "pintool",
+    "shared_coverage", "", "Shared coverage region of the owner process (set for child processes by -follow_child)");
+
 KNOB<BOOL> KnobDumpOnExit(KNOB_MODE_WRITEONCE, "pintool",
     "dump_on_exit", "0", "Dump coverage on process exit (for standalone test executables)");
 
+KNOB<BOOL> KnobBbl(KNOB_MODE_WRITEONCE, "pintool",
+    "bbl", "0", "Record basic block coverage in DynamoRIO client format (runtime_dump mode)");
+
+KNOB<BOOL> KnobTextDump(KNOB_MODE_WRITEONCE, "pintool",
+    "text_dump", "0", "Write text instead of binary basic block dumps (-bbl mode)");
+
+KNOB<BOOL> KnobBinaryDump(KNOB_MODE_WRITEONCE, "pintool",
+    "binary_dump", "0", "Write function start offsets as binary dumps, without symbols (runtime_dump mode)");
+
+KNOB<BOOL> KnobProbe(KNOB_MODE_WRITEONCE, "pintool",
+    "probe", "0", "Record function coverage with probes instead of JIT instrumentation (runtime_dump mode)");
+
+KNOB<BOOL> KnobEdges(KNOB_MODE_WRITEONCE, "pintool",
+    "edges", "0", "Also record caller-callee edges per test (runtime_dump mode)");
+
+KNOB<UINT32> KnobEdgeBudget(KNOB_MODE_WRITEONCE, "pintool",
+    "edge_budget", "64", "Memory budget of the edge tables in MB (edges mode)");
+
+KNOB<std::string> KnobDumpPrefix(KNOB_MODE_WRITEONCE, "pintool",
+    "dump_prefix", "", "Prefix of dump files and lookup entries (default: shard<N>_ if GoogleTest sharding is enabled)");
+
 KNOB<std::string> KnobTraceOnly(KNOB_MODE_WRITEONCE, "pintool",
-    "trace_only", "", "Only trace/record coverage for executables matching these patterns (comma-separated, supports prefix* wildcards)");
+    "trace_only", "", "Only trace/record coverage for executables matching these patterns (comma-separated, supports * and ? wildcards)");
 
 /* ===================================================================== */
 /* Global Variables                                                      */
@@ -82,22 +147,157 @@ static std::mutex TraceLock;
 
 /* Test mode state */
 static int DumpCount = 0;
-static std::ofstream LookupFile;
-static std::unordered_set<ADDRINT> CurrentTestFunctions;
-static std::string ProcessSuffix;  // Unique suffix for this process (PID-based)
+static int LookupFd = -1;          // Opened with O_APPEND, every entry is a single write
+static std::string ProcessSuffix;  // Unique suffix for this process (dump prefix and PID-based)
+static std::string DumpPrefix;     // -dump_prefix, or shard<N>_ for GoogleTest shards
+
+/* Images that contain instrumented functions */
+struct ImageInfo {
+    std::string name;
+    std::string path;
+    ADDRINT low;
+    INT32 sharedIndex;  // Index into the shared image table (-follow_child), -1 if not published yet
+};
+static std::vector<ImageInfo> Images;                  // Guarded by TraceLock
+static std::unordered_map<UINT32, UINT32> ImageIndex;  // IMG_Id -> index into Images, guarded by TraceLock
 
-/* Function metadata for coverage dumps */
+/* Function metadata, indexed by a dense function id assigned at instrumentation time.
+ * Only the address is known up front, name and source location are looked up the first
+ * time a function is dumped (or traced) and then memoized. */
 struct FunctionInfo {
-    std::string imgName;
-    std::string imgPath;
     std::string rtnName;
     std::string srcFile;
     ADDRINT rtnAddr;
-    ADDRINT imgLow;
+    UINT32 imgIndex;
     UINT32 rtnSize;
     INT32 srcLine;
+    bool resolved;
 };
-static std::unordered_map<ADDRINT, FunctionInfo> FunctionMetadata;
+static std::deque<FunctionInfo> Functions;  // Guarded by TraceLock
+
+/* Basic blocks (-bbl mode), indexed by a dense block id. Blocks are deduplicated by address,
+ * as Pin may instrument the same block in several traces. */
+struct BlockInfo {
+    ADDRINT addr;
+    UINT32 imgIndex;
+};
+static std::deque<BlockInfo> Blocks;                   // Guarded by TraceLock
+static std::unordered_map<ADDRINT, UINT32> BlockIds;   // Guarded by TraceLock
+
+/* Covered flags of the current test segment (runtime_dump mode), indexed by function (or block) id.
+ * Pages are allocated when ids are assigned and never moved, such that the analysis routine
+ * is a single lock-free byte store that Pin can inline.
+ * There are several flag sets, a dump swaps the active set with a free one and hands the old
+ * set to the writer thread, which collects, writes and clears it. A store that races with the
+ * swap may still land in the old set, i.e., it is attributed to the test that just finished. */
+static const UINT32 FLAG_PAGE_BITS = 16;
+static const UINT32 FLAG_PAGE_SIZE = 1U << FLAG_PAGE_BITS;
+static const UINT32 FLAG_PAGE_MASK = FLAG_PAGE_SIZE - 1;
+static const UINT32 MAX_FLAG_PAGES = 1024;  // Up to 64M functions
+static const UINT32 NUM_FLAG_SETS = 4;      // Bounds the dump queue to NUM_FLAG_SETS - 1 pending dumps
+static UINT8* FlagSets[NUM_FLAG_SETS][MAX_FLAG_PAGES];
+static UINT8** volatile CoveredFlags = FlagSets[0];  // Active set
+
+/* Caller-callee edges of the test segments (-edges mode), one table per flag set. Tables are
+ * open-addressing hash sets of (caller + 1) << 32 | (callee + 1) keys with a fixed size, inserts are
+ * lock-free; edges that do not fit within MAX_EDGE_PROBES slots are dropped and counted. */
+static const UINT32 NO_CALLER = 0xffffffff;  // Encoded as 0, i.e., the thread's first function
+static const UINT32 MAX_EDGE_PROBES = 32;
+struct EdgeTable {
+    UINT64* slots;
+    UINT64 mask;
+    UINT32 dropped;
+};
+static EdgeTable EdgeTables[NUM_FLAG_SETS];
+static EdgeTable* volatile ActiveEdges = &EdgeTables[0];
+
+/* Shadow call stack of a thread (-edges mode). Frames are popped based on the stack pointer at
+ * function entry, so returns need not be instrumented (and longjmp/exceptions unwind correctly).
+ * Beyond MAX_SHADOW_DEPTH, the deepest frame is replaced, which keeps memory bounded under
+ * deep recursion while the innermost caller stays exact. */
+static const UINT32 MAX_SHADOW_DEPTH = 4096;
+struct ShadowFrame {
+    ADDRINT sp;
+    UINT32 id;
+};
+struct ShadowStack {
+    UINT32 depth;
+    ShadowFrame frames[MAX_SHADOW_DEPTH];
+};
+static TLS_KEY ShadowStackKey = INVALID_TLS_KEY;
+
+/* Coverage of child processes (-follow_child), shared through a POSIX shared memory region. The first
+ * process creates (owns) the region, forked children inherit it and exec'd children get its name with
+ * -shared_coverage. Children publish the image offsets they covered when they exit, and the owner merges
+ * them into its next dump.
+ * Published entries form a ring buffer and the total only grows, such that a dump consumes exactly
+ * the entries that were published before its test ended. */
+static const UINT32 SHARED_MAGIC = 0x53525450;  // "PTRS"
+static const UINT32 MAX_SHARED_IMAGES = 1024;
+static const UINT32 MAX_SHARED_NAME = 128;
+static const UINT32 MAX_SHARED_PATH = 512;
+static const UINT64 SHARED_RING_SIZE = 1ULL << 20;
+struct SharedImage {
+    char name[MAX_SHARED_NAME];
+    char path[MAX_SHARED_PATH];
+};
+struct SharedEntry {
+    UINT64 offset;
+    UINT32 image;
+    UINT32 reserved;
+};
+struct SharedCoverage {
+    UINT32 magic;
+    INT32 ownerPid;
+    INT32 lockPid;         // Process holding the lock, 0 if unlocked
+    UINT32 ownerCollects;  // Children only publish while the owner merges them into its dumps
+    UINT32 numImages;
+    UINT32 reserved;
+    UINT64 published;      // Total number of entries ever published
+    SharedImage images[MAX_SHARED_IMAGES];
+    SharedEntry entries[SHARED_RING_SIZE];
+};
+static SharedCoverage* Shared = nullptr;
+static std::string SharedName;
+static bool SharedOwner = false;
+static bool DumpsItself = false;                // Whether this process wrote dumps per test (pin_rts_dump_coverage)
+static std::vector<std::string> PinCommandLine;  // Pin and tool arguments, passed on to exec'd children
+static UINT64 SharedConsumed = 0;  // Owner only, guarded by TraceLock
+
+/* Child coverage of a dump, image path -> (image name, offsets) */
+struct ChildModule {
+    std::string name;
+    std::set<ADDRINT> offsets;
+};
+typedef std::map<std::string, ChildModule> ChildCoverage;
+
+/* Asynchronous dump writer (runtime_dump mode) */
+struct DumpJob {
+    UINT8** flags;
+    std::string dumpId;
+    UINT64 childEntries;  // Child coverage published before the test ended
+};
+static std::mutex QueueLock;
+static std::deque<DumpJob> DumpQueue;      // Guarded by QueueLock
+static std::vector<UINT8**> FreeFlagSets;  // Guarded by QueueLock
+static bool WriterStopping = false;        // Guarded by QueueLock
+static bool WriterRunning = false;         // Dumps are written synchronously if the writer is not running
+static PIN_THREAD_UID WriterUid;
+static PIN_SEMAPHORE JobQueued;
+static PIN_SEMAPHORE FlagSetFreed;
+
+/* Call trace state (-all mode), see functrace_calls.h */
+static const UINT32 CALL_BUFFER_PAGES = 64;
+static const size_t MAX_PENDING_CALL_BUFFERS = 16;
+struct CallChunk {
+    VOID* buf;
+    UINT64 numRecords;
+};
+static BUFFER_ID CallBufferId = BUFFER_ID_INVALID;
+static FILE* CallsFile = nullptr;             // Guarded by TraceLock
+static std::deque<CallChunk> CallQueue;       // Guarded by QueueLock
+static std::vector<VOID*> FreeCallBuffers;    // Guarded by QueueLock
+static PIN_SEMAPHORE CallBufferWritten;
 
 /* Main executable info for output header */
 static std::string MainExeName;
@@ -106,6 +306,14 @@ static std::string MainExePath;
 /* Process filtering */
 static bool ShouldTraceProcess = true;  // Set to false if process doesn't match -trace_only
 
+/* Image filters, compiled once from -exclude and -trace_only (nullptr if empty) */
+static filter_t* ExcludeFilter = nullptr;
+static filter_t* TraceOnlyFilter = nullptr;
+
+// Result of ShouldInstrumentImage per image id, only accessed from instrumentation and image
+// callbacks, which Pin serializes by the client lock
+static std::unordered_map<UINT32, bool> InstrumentedImages;
+
 /* ===================================================================== */
 /* Helper Functions                                                      */
 /* ===================================================================== */
@@ -119,31 +327,56 @@ static std::string BaseName(const std::string& path)
     return path.substr(pos + 1);
 }
 
-// Check if image should be excluded based on -exclude patterns
-static bool ShouldExcludeImage(const std::string& imgName)
+static void* FilterAlloc(size_t size)
 {
-    if (KnobNoExclude.Value())
-        return false;
+    return malloc(size);
+}
 
-    std::string excludeList = KnobExclude.Value();
-    if (excludeList.empty())
-        return false;
+static void FilterFree(void* ptr, size_t size)
+{
+    free(ptr);
+}
 
-    // Parse comma-separated exclusion patterns
-    size_t start = 0;
-    size_t end;
-    while ((end = excludeList.find(',', start)) != std::string::npos) {
-        std::string pattern = excludeList.substr(start, end - start);
-        if (!pattern.empty() && imgName.find(pattern) != std::string::npos)
-            return true;
-        start = end + 1;
-    }
-    // Check last pattern (after final comma or if no commas)
-    std::string pattern = excludeList.substr(start);
-    if (!pattern.empty() && imgName.find(pattern) != std::string::npos)
-        return true;
+// Compile a comma-separated pattern list into a filter, returns nullptr for an empty list
+static filter_t* CompileFilter(const std::string& patterns, filter_plain_mode_t plainMode)
+{
+    static const filter_allocator_t allocator = { FilterAlloc, FilterFree };
+    filter_t* filter = filter_create(&allocator, plainMode);
+    if (filter == nullptr || !filter_add_list(filter, patterns.c_str(), ',') || !filter_compile(filter)) {
+        std::cerr << "Error: Out of memory while compiling image filters" << std::endl;
+        PIN_ExitProcess(1);
+    }
+    if (filter_size(filter) == 0) {
+        filter_destroy(filter);
+        return nullptr;
+    }
+    return filter;
+}
+
+// Compile the -exclude (substring) and -trace_only (exact) filters
+static VOID InitImageFilters()
+{
+    if (!KnobNoExclude.Value())
+        ExcludeFilter = CompileFilter(KnobExclude.Value(), FILTER_PLAIN_SUBSTRING);
+    TraceOnlyFilter = CompileFilter(KnobTraceOnly.Value(), FILTER_PLAIN_EXACT);
+}
 
-    return false;
+// Check if image should be excluded based on -exclude patterns
+static bool ShouldExcludeImage(const std::string& imgName)
+{
+    return ExcludeFilter != nullptr && filter_matches(ExcludeFilter, imgName.c_str());
+}
+
+// Prefix of dump files, shards of a GoogleTest binary (GTEST_TOTAL_SHARDS > 1) usually share the log directory
+static std::string GetDumpPrefix()
+{
+    if (!KnobDumpPrefix.Value().empty())
+        return KnobDumpPrefix.Value();
+    const char* totalShards = getenv("GTEST_TOTAL_SHARDS");
+    const char* shardIndex = getenv("GTEST_SHARD_INDEX");
+    if (totalShards == nullptr || shardIndex == nullptr || atoi(totalShards) <= 1)
+        return "";
+    return "shard" + std::to_string(atoi(shardIndex)) + "_";
 }
 
 // Create directory if it doesn't exist
@@ -157,232 +390,1007 @@ static bool EnsureDirectory(const std::string& path)
 }
 
 // Check if executable name matches -trace_only patterns
-// Patterns are comma-separated, supports suffix matching with * wildcard (e.g., "test-*")
+// Patterns are comma-separated globs (e.g., "test-*", "*_unittests", "*gtest*")
 static bool MatchesTraceOnlyPatterns(const std::string& exeName)
 {
-    std::string patterns = KnobTraceOnly.Value();
-    if (patterns.empty())
+    if (TraceOnlyFilter == nullptr)
         return true;  // No filter = trace everything
+    return filter_matches(TraceOnlyFilter, exeName.c_str());
+}
 
-    size_t start = 0;
-    size_t end;
-    while (true) {
-        end = patterns.find(',', start);
-        std::string pattern = (end == std::string::npos) ?
-            patterns.substr(start) : patterns.substr(start, end - start);
-
-        // Trim whitespace
-        size_t pstart = pattern.find_first_not_of(" \t");
-        size_t pend = pattern.find_last_not_of(" \t");
-        if (pstart != std::string::npos && pend != std::string::npos) {
-            pattern = pattern.substr(pstart, pend - pstart + 1);
+/* ===================================================================== */
+/* Coverage Dump Handler - Called when marker function is invoked        */
+/* ===================================================================== */
+
+// Lock order: the Pin client lock (required for symbol lookups) is always taken before TraceLock.
+
+// Look up the image table entry, registering the image on first use (caller holds TraceLock)
+static UINT32 GetImageIndex(IMG img)
+{
+    auto it = ImageIndex.find(IMG_Id(img));
+    if (it != ImageIndex.end())
+        return it->second;
+
+    ImageInfo image;
+    image.path = IMG_Name(img);
+    image.name = BaseName(image.path);
+    image.low = IMG_LowAddress(img);
+    image.sharedIndex = -1;
+    UINT32 index = static_cast<UINT32>(Images.size());
+    Images.push_back(image);
+    ImageIndex[IMG_Id(img)] = index;
+    return index;
+}
+
+// Look up name and source location of a function once (caller holds client lock and TraceLock)
+static VOID ResolveFunction(FunctionInfo& info)
+{
+    if (info.resolved)
+        return;
+
+    // Try to get source location (requires debug info)
+    INT32 srcColumn = 0;
+    info.rtnName = RTN_FindNameByAddress(info.rtnAddr);
+    PIN_GetSourceLocation(info.rtnAddr, &srcColumn, &info.srcLine, &info.srcFile);
+    info.resolved = true;
+}
+
+// Make sure the covered flag of an id exists (caller holds TraceLock)
+static bool EnsureCoveredFlag(UINT32 id)
+{
+    UINT32 page = id >> FLAG_PAGE_BITS;
+    if (page >= MAX_FLAG_PAGES)
+        return false;
+    for (UINT32 set = 0; set < NUM_FLAG_SETS; set++) {
+        if (FlagSets[set][page] == nullptr) {
+            FlagSets[set][page] = static_cast<UINT8*>(calloc(FLAG_PAGE_SIZE, sizeof(UINT8)));
+            if (FlagSets[set][page] == nullptr)
+                return false;
         }
+    }
+    return true;
+}
 
-        if (!pattern.empty()) {
-            // Check for wildcard at end (prefix match)
-            if (pattern.back() == '*') {
-                std::string prefix = pattern.substr(0, pattern.length() - 1);
-                if (exeName.compare(0, prefix.length(), prefix) == 0) {
-                    return true;
-                }
-            }
-            // Check for wildcard at start (suffix match)
-            else if (pattern.front() == '*') {
-                std::string suffix = pattern.substr(1);
-                if (exeName.length() >= suffix.length() &&
-                    exeName.compare(exeName.length() - suffix.length(), suffix.length(), suffix) == 0) {
-                    return true;
-                }
-            }
-            // Exact match
-            else if (exeName == pattern) {
-                return true;
-            }
+// Assign the next dense id to a function (caller holds TraceLock)
+static bool AddFunction(const FunctionInfo& info, UINT32* id)
+{
+    *id = static_cast<UINT32>(Functions.size());
+    if (!EnsureCoveredFlag(*id))
+        return false;
+    Functions.push_back(info);
+    return true;
+}
+
+// Assign the next dense id to a block, or return the id it already has (caller holds TraceLock)
+static bool AddBlock(const BlockInfo& info, UINT32* id)
+{
+    auto it = BlockIds.find(info.addr);
+    if (it != BlockIds.end()) {
+        *id = it->second;
+        return true;
+    }
+    *id = static_cast<UINT32>(Blocks.size());
+    if (!EnsureCoveredFlag(*id))
+        return false;
+    Blocks.push_back(info);
+    BlockIds[info.addr] = *id;
+    return true;
+}
+
+// Offset of a covered function (or block) within its image (caller holds TraceLock)
+static UINT32 CoveredImageIndex(UINT32 id)
+{
+    return KnobBbl.Value() ? Blocks[id].imgIndex : Functions[id].imgIndex;
+}
+
+static ADDRINT CoveredOffset(UINT32 id)
+{
+    ADDRINT addr = KnobBbl.Value() ? Blocks[id].addr : Functions[id].rtnAddr;
+    return addr - Images[CoveredImageIndex(id)].low;
+}
+
+// Map the shared child coverage region of the owner (-shared_coverage, set for exec'd children by
+// FollowChildProcess), or create a region owned by this process
+static bool InitSharedCoverage()
+{
+    bool created = false;
+    int fd = -1;
+    if (!KnobSharedCoverage.Value().empty()) {
+        SharedName = KnobSharedCoverage.Value();
+        fd = shm_open(SharedName.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        // Named after the owner, such that unrelated processes with the same log directory never share a region
+        SharedName = "/binaryrts-pin-" + std::to_string(PIN_GetPid());
+        fd = shm_open(SharedName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            // Left over from a crashed process with the same PID
+            shm_unlink(SharedName.c_str());
+            fd = shm_open(SharedName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
         }
+        created = fd >= 0;
+    }
+    if (fd < 0)
+        return false;
+    if (created && ftruncate(fd, sizeof(SharedCoverage)) != 0) {
+        close(fd);
+        shm_unlink(SharedName.c_str());
+        return false;
+    }
+    void* mem = mmap(nullptr, sizeof(SharedCoverage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        if (created)
+            shm_unlink(SharedName.c_str());
+        return false;
+    }
+    Shared = static_cast<SharedCoverage*>(mem);
+
+    if (created) {
+        SharedOwner = true;
+        Shared->ownerPid = PIN_GetPid();
+        Shared->lockPid = 0;
+        Shared->ownerCollects = 0;
+        Shared->numImages = 0;
+        Shared->published = 0;
+        __atomic_store_n(&Shared->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+    } else if (__atomic_load_n(&Shared->magic, __ATOMIC_ACQUIRE) != SHARED_MAGIC) {
+        munmap(Shared, sizeof(SharedCoverage));
+        Shared = nullptr;
+        return false;
+    }
+    return true;
+}
+
+static VOID ReleaseSharedCoverage()
+{
+    if (Shared == nullptr)
+        return;
+    munmap(Shared, sizeof(SharedCoverage));
+    Shared = nullptr;
+    if (SharedOwner)
+        shm_unlink(SharedName.c_str());
+}
 
-        if (end == std::string::npos) break;
-        start = end + 1;
+static VOID LockShared()
+{
+    INT32 self = PIN_GetPid();
+    for (UINT32 spins = 1;; spins++) {
+        INT32 holder = 0;
+        if (__atomic_compare_exchange_n(&Shared->lockPid, &holder, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+        // A process that died while holding the lock must not block all others
+        if (spins % 1024 == 0 && holder != self && kill(holder, 0) != 0 && errno == ESRCH)
+            __atomic_compare_exchange_n(&Shared->lockPid, &holder, 0, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        sched_yield();
     }
+}
 
-    return false;
+static VOID UnlockShared()
+{
+    __atomic_store_n(&Shared->lockPid, 0, __ATOMIC_RELEASE);
 }
 
-/* ===================================================================== */
-/* Coverage Dump Handler - Called when marker function is invoked        */
-/* ===================================================================== */
+// Whether the owner currently merges child coverage into its dumps (-trace_only, and it writes dumps
+// per test or on exit); it stops before its final dump
+static VOID SetOwnerCollects(bool collects)
+{
+    if (Shared == nullptr || !SharedOwner)
+        return;
+    LockShared();
+    __atomic_store_n(&Shared->ownerCollects, collects ? 1U : 0U, __ATOMIC_RELEASE);
+    UnlockShared();
+}
 
-static VOID HandleCoverageDump(ADDRINT dumpIdArg)
+static UINT64 SharedPublished()
 {
-    const char* dumpId = reinterpret_cast<const char*>(dumpIdArg);
+    return Shared != nullptr ? __atomic_load_n(&Shared->published, __ATOMIC_ACQUIRE) : 0;
+}
 
-    std::lock_guard<std::mutex> guard(TraceLock);
+// Index of an image in the shared image table, added if missing (caller holds the shared lock)
+static INT32 GetSharedImageIndex(const ImageInfo& image)
+{
+    UINT32 numImages = Shared->numImages;
+    for (UINT32 index = 0; index < numImages; index++) {
+        if (strncmp(Shared->images[index].path, image.path.c_str(), MAX_SHARED_PATH) == 0)
+            return index;
+    }
+    if (numImages == MAX_SHARED_IMAGES)
+        return -1;
+    SharedImage& shared = Shared->images[numImages];
+    snprintf(shared.name, MAX_SHARED_NAME, "%s", image.name.c_str());
+    snprintf(shared.path, MAX_SHARED_PATH, "%s", image.path.c_str());
+    Shared->numImages = numImages + 1;
+    return numImages;
+}
 
-    DumpCount++;
+// Publish the covered functions (or blocks) of a child process to the owner, returns false if the
+// owner does not collect them, such that the child writes its own dump instead (caller holds TraceLock)
+static bool PublishChildCoverage(const std::vector<UINT32>& ids)
+{
+    if (Shared == nullptr || SharedOwner)
+        return false;
 
-    // Write current coverage to numbered file (include PID suffix if following children)
-    std::string filename = KnobLogDir.Value() + "/" + ProcessSuffix + std::to_string(DumpCount) + ".log";
-    std::ofstream dumpFile(filename);
+    LockShared();
+    // An owner that died without unlinking the region collects nothing either
+    bool collects = Shared->ownerCollects != 0 && !(kill(Shared->ownerPid, 0) != 0 && errno == ESRCH);
+    for (UINT32 i = 0; collects && i < ids.size(); i++) {
+        UINT32 id = ids[i];
+        ImageInfo& image = Images[CoveredImageIndex(id)];
+        if (image.sharedIndex < 0)
+            image.sharedIndex = GetSharedImageIndex(image);
+        if (image.sharedIndex < 0)
+            continue;
+        SharedEntry& entry = Shared->entries[Shared->published % SHARED_RING_SIZE];
+        entry.offset = CoveredOffset(id);
+        entry.image = static_cast<UINT32>(image.sharedIndex);
+        __atomic_store_n(&Shared->published, Shared->published + 1, __ATOMIC_RELEASE);
+    }
+    UnlockShared();
+    return collects;
+}
+
+// Consume the child coverage published up to a snapshot of the published total (caller holds TraceLock)
+static ChildCoverage CollectChildCoverage(UINT64 upTo)
+{
+    ChildCoverage children;
+    if (Shared == nullptr || !SharedOwner)
+        return children;
+
+    LockShared();
+    if (Shared->published - SharedConsumed > SHARED_RING_SIZE) {
+        std::cerr << "Warning: Child coverage overflowed, " << (Shared->published - SharedConsumed - SHARED_RING_SIZE)
+                  << " entries lost" << std::endl;
+        SharedConsumed = Shared->published - SHARED_RING_SIZE;
+    }
+    for (; SharedConsumed < upTo; SharedConsumed++) {
+        const SharedEntry& entry = Shared->entries[SharedConsumed % SHARED_RING_SIZE];
+        const SharedImage& image = Shared->images[entry.image];
+        ChildModule& module = children[image.path];
+        module.name = image.name;
+        module.offsets.insert(entry.offset);
+    }
+    UnlockShared();
+    return children;
+}
+
+// Index of a flag set, edge tables are paired with flag sets
+static UINT32 FlagSetIndex(UINT8** flags)
+{
+    UINT32 set = 0;
+    while (set + 1 < NUM_FLAG_SETS && FlagSets[set] != flags)
+        set++;
+    return set;
+}
+
+// Allocate the edge tables, each gets an equal share of -edge_budget rounded down to a power of two
+static bool InitEdgeTables()
+{
+    UINT64 budgetSlots = (static_cast<UINT64>(KnobEdgeBudget.Value()) << 20) / sizeof(UINT64) / NUM_FLAG_SETS;
+    UINT64 numSlots = 1024;
+    while (numSlots * 2 <= budgetSlots)
+        numSlots *= 2;
+    for (UINT32 set = 0; set < NUM_FLAG_SETS; set++) {
+        EdgeTables[set].slots = static_cast<UINT64*>(calloc(numSlots, sizeof(UINT64)));
+        if (EdgeTables[set].slots == nullptr)
+            return false;
+        EdgeTables[set].mask = numSlots - 1;
+        EdgeTables[set].dropped = 0;
+    }
+    return true;
+}
+
+// Collect and reset the edges of a test segment, paired with its flag set (caller holds TraceLock)
+static std::vector<UINT64> CollectCurrentTestEdges(UINT8** flags, UINT32* dropped)
+{
+    std::vector<UINT64> edges;
+    *dropped = 0;
+    if (!KnobEdges.Value() || !ShouldTraceProcess)
+        return edges;
+
+    EdgeTable& table = EdgeTables[FlagSetIndex(flags)];
+    for (UINT64 slot = 0; slot <= table.mask; slot++) {
+        if (table.slots[slot] != 0) {
+            edges.push_back(table.slots[slot]);
+            table.slots[slot] = 0;
+        }
+    }
+    *dropped = __atomic_exchange_n(&table.dropped, 0, __ATOMIC_RELAXED);
+    return edges;
+}
+
+// Collect and reset the covered flags of a test segment (caller holds TraceLock)
+static std::vector<UINT32> CollectCurrentTestFunctions(UINT8** flags)
+{
+    std::vector<UINT32> ids;
+    // Skip if this process doesn't match -trace_only filter
+    if (!ShouldTraceProcess)
+        return ids;
+
+    UINT32 numFunctions = static_cast<UINT32>(KnobBbl.Value() ? Blocks.size() : Functions.size());
+    for (UINT32 id = 0; id < numFunctions; id++) {
+        UINT8& flag = flags[id >> FLAG_PAGE_BITS][id & FLAG_PAGE_MASK];
+        if (flag) {
+            ids.push_back(id);
+            flag = 0;
+        }
+    }
+    return ids;
+}
+
+// Open a dump file with a large stdio buffer, dumps are only written while holding TraceLock
+static FILE* OpenDumpFile(const std::string& filename)
+{
+    static char buffer[1 << 20];
+    FILE* dumpFile = fopen(filename.c_str(), "wb");
+    if (dumpFile != nullptr)
+        setvbuf(dumpFile, buffer, _IOFBF, sizeof(buffer));
+    return dumpFile;
+}
+
+// Write the binary offsets section of a module, as the DynamoRIO client does
+// Format: <tab>BBs: <count>, followed by raw pointer-sized offsets and a newline
+static VOID WriteBinaryOffsets(FILE* dumpFile, const std::vector<void*>& offsets)
+{
+    fprintf(dumpFile, "\tBBs: %zu\n", offsets.size());
+    fwrite(offsets.data(), sizeof(void*), offsets.size(), dumpFile);
+    fputc('\n', dumpFile);
+}
+
+/* A module section of a dump, covered ids are kept such that functions can be written with symbols */
+struct DumpSection {
+    std::string name;
+    std::string path;
+    std::vector<UINT32> ids;
+    std::vector<ADDRINT> childOffsets;  // Covered by child processes only (-follow_child)
+};
 
-    if (dumpFile.is_open()) {
+// Group covered ids by image and merge in the coverage of child processes (caller holds TraceLock)
+static std::vector<DumpSection> BuildDumpSections(const std::vector<UINT32>& ids, const ChildCoverage& children)
+{
+    std::vector<DumpSection> sections;
+    std::vector<INT32> sectionOfImage(Images.size(), -1);
+    std::unordered_map<std::string, UINT32> sectionOfPath;
+    for (UINT32 id : ids) {
+        UINT32 imgIndex = CoveredImageIndex(id);
+        if (sectionOfImage[imgIndex] < 0) {
+            sectionOfImage[imgIndex] = static_cast<INT32>(sections.size());
+            sectionOfPath.emplace(Images[imgIndex].path, static_cast<UINT32>(sections.size()));
+            sections.push_back(DumpSection{Images[imgIndex].name, Images[imgIndex].path, {}, {}});
+        }
+        sections[sectionOfImage[imgIndex]].ids.push_back(id);
+    }
+
+    for (const auto& child : children) {
+        auto it = sectionOfPath.find(child.first);
+        if (it == sectionOfPath.end()) {
+            it = sectionOfPath.emplace(child.first, static_cast<UINT32>(sections.size())).first;
+            sections.push_back(DumpSection{child.second.name, child.first, {}, {}});
+        }
+        DumpSection& section = sections[it->second];
+        std::unordered_set<ADDRINT> ownOffsets;
+        for (UINT32 id : section.ids)
+            ownOffsets.insert(CoveredOffset(id));
+        for (ADDRINT offset : child.second.offsets) {
+            if (ownOffsets.count(offset) == 0)
+                section.childOffsets.push_back(offset);
+        }
+    }
+    return sections;
+}
+
+// All offsets of a section, as written in binary dumps (caller holds TraceLock)
+static std::vector<void*> SectionOffsets(const DumpSection& section)
+{
+    std::vector<void*> offsets;
+    offsets.reserve(section.ids.size() + section.childOffsets.size());
+    for (UINT32 id : section.ids)
+        offsets.push_back(reinterpret_cast<void*>(CoveredOffset(id)));
+    for (ADDRINT offset : section.childOffsets)
+        offsets.push_back(reinterpret_cast<void*>(offset));
+    return offsets;
+}
+
+// Write covered blocks grouped by image, in the format of the DynamoRIO client (caller holds TraceLock)
+static VOID WriteBlockDump(const std::string& filename, const std::vector<DumpSection>& sections)
+{
+    FILE* dumpFile = OpenDumpFile(filename);
+    if (dumpFile == nullptr)
+        return;
+
+    for (const DumpSection& section : sections) {
+        std::vector<void*> offsets = SectionOffsets(section);
+
+        // Header line: module_name<tab>module_path
+        fprintf(dumpFile, "%s\t%s\n", section.name.c_str(), section.path.c_str());
+        if (KnobTextDump.Value()) {
+            // Format: <tab>+<offset><tab><hit count> (hit counts are not recorded)
+            for (void* offset : offsets)
+                fprintf(dumpFile, "\t+0x%lx\t1\n", reinterpret_cast<unsigned long>(offset));
+        } else {
+            WriteBinaryOffsets(dumpFile, offsets);
+        }
+    }
+    fclose(dumpFile);
+}
+
+// Functions of this process at the child offsets of the dump sections, by section index and image offset,
+// such that functions covered by child processes are symbolized as well (caller holds TraceLock)
+static std::vector<std::unordered_map<ADDRINT, UINT32>> FindChildFunctions(const std::vector<DumpSection>& sections)
+{
+    std::vector<std::unordered_map<ADDRINT, UINT32>> functions(sections.size());
+    std::unordered_map<std::string, UINT32> sectionOfPath;
+    for (UINT32 index = 0; index < sections.size(); index++) {
+        if (!sections[index].childOffsets.empty())
+            sectionOfPath.emplace(sections[index].path, index);
+    }
+    if (sectionOfPath.empty())
+        return functions;
+
+    // Functions of unloaded images can only be used if they were resolved before the image was unloaded
+    std::unordered_set<UINT32> loadedImages;
+    for (const auto& image : ImageIndex)
+        loadedImages.insert(image.second);
+    std::unordered_map<UINT32, UINT32> sectionOfImage;
+    for (UINT32 index = 0; index < Images.size(); index++) {
+        auto it = sectionOfPath.find(Images[index].path);
+        if (it != sectionOfPath.end())
+            sectionOfImage.emplace(index, it->second);
+    }
+    for (UINT32 id = 0; id < Functions.size(); id++) {
+        const FunctionInfo& info = Functions[id];
+        auto it = sectionOfImage.find(info.imgIndex);
+        if (it != sectionOfImage.end() && (info.resolved || loadedImages.count(info.imgIndex) > 0))
+            functions[it->second].emplace(info.rtnAddr - Images[info.imgIndex].low, id);
+    }
+    return functions;
+}
+
+// Write covered functions grouped by image, with one header per module (caller holds client lock and TraceLock)
+static VOID WriteFunctionDump(const std::string& filename, const std::vector<DumpSection>& sections)
+{
+    FILE* dumpFile = OpenDumpFile(filename);
+    if (dumpFile == nullptr)
+        return;
+
+    std::vector<std::unordered_map<ADDRINT, UINT32>> childFunctions;
+    if (!KnobBinaryDump.Value())
+        childFunctions = FindChildFunctions(sections);
+
+    for (UINT32 index = 0; index < sections.size(); index++) {
+        const DumpSection& section = sections[index];
         // Header line: module_name<tab>module_path
-        dumpFile << MainExeName << "\t" << MainExePath << "\n";
+        fprintf(dumpFile, "%s\t%s\n", section.name.c_str(), section.path.c_str());
+
+        if (KnobBinaryDump.Value()) {
+            // Function start offsets only, symbols are resolved by binary_rts_resolver
+            WriteBinaryOffsets(dumpFile, SectionOffsets(section));
+            continue;
+        }
 
         // Write each function that was called during this test segment
         // Format: <tab>+<offset><tab><source_file><tab><symbol><tab><line>
-        for (ADDRINT addr : CurrentTestFunctions) {
-            auto it = FunctionMetadata.find(addr);
-            if (it != FunctionMetadata.end()) {
-                const FunctionInfo& info = it->second;
-                ADDRINT offset = info.rtnAddr - info.imgLow;
-                dumpFile << "\t+0x" << std::hex << offset << std::dec
-                         << "\t" << (info.srcFile.empty() ? "??" : info.srcFile)
-                         << "\t" << info.rtnName
-                         << "\t" << info.srcLine
-                         << "\n";
+        for (UINT32 id : section.ids) {
+            FunctionInfo& info = Functions[id];
+            ResolveFunction(info);
+            fprintf(dumpFile, "\t+0x%lx\t%s\t%s\t%d\n",
+                    static_cast<unsigned long>(CoveredOffset(id)),
+                    info.srcFile.empty() ? "??" : info.srcFile.c_str(),
+                    info.rtnName.c_str(),
+                    info.srcLine);
+        }
+        // Functions covered by child processes are symbolized with the functions of this process, if it
+        // has loaded the same image. Others are written without symbols, which the CLI skips unless
+        // binary_rts_resolver symbolized the dump from its offsets beforehand.
+        for (ADDRINT offset : section.childOffsets) {
+            auto it = childFunctions[index].find(offset);
+            if (it == childFunctions[index].end()) {
+                fprintf(dumpFile, "\t+0x%lx\t??\t??\t0\n", static_cast<unsigned long>(offset));
+                continue;
             }
+            FunctionInfo& info = Functions[it->second];
+            ResolveFunction(info);
+            fprintf(dumpFile, "\t+0x%lx\t%s\t%s\t%d\n",
+                    static_cast<unsigned long>(offset),
+                    info.srcFile.empty() ? "??" : info.srcFile.c_str(),
+                    info.rtnName.c_str(),
+                    info.srcLine);
         }
-        dumpFile.close();
     }
+    fclose(dumpFile);
+}
 
-    // Update lookup file (include suffix to match log filename)
-    if (LookupFile.is_open()) {
-        LookupFile << ProcessSuffix << DumpCount << ";" << dumpId << std::endl;
-        LookupFile.flush();
+// Write one side of an edge: <image><tab>+<offset><tab><symbol> (caller holds client lock and TraceLock)
+static VOID WriteEdgeFunction(FILE* edgeFile, UINT32 id)
+{
+    if (id == NO_CALLER) {
+        fputs("<root>\t+0x0\t<root>", edgeFile);
+        return;
     }
+    FunctionInfo& info = Functions[id];
+    ResolveFunction(info);
+    const ImageInfo& image = Images[info.imgIndex];
+    fprintf(edgeFile, "%s\t+0x%lx\t%s", image.name.c_str(),
+            static_cast<unsigned long>(info.rtnAddr - image.low), info.rtnName.c_str());
+}
+
+// Write the caller-callee edges of a test segment (caller holds client lock and TraceLock)
+// Format: <caller image><tab>+<offset><tab><symbol><tab><callee image><tab>+<offset><tab><symbol>
+static VOID WriteEdgeDump(const std::string& filename, const std::vector<UINT64>& edges, UINT32 dropped)
+{
+    FILE* edgeFile = OpenDumpFile(filename);
+    if (edgeFile == nullptr)
+        return;
 
-    // Reset coverage for next test segment
-    CurrentTestFunctions.clear();
+    if (dropped > 0)
+        fprintf(edgeFile, "# dropped %u edges, increase -edge_budget\n", dropped);
+    for (UINT64 edge : edges) {
+        WriteEdgeFunction(edgeFile, static_cast<UINT32>(edge >> 32) - 1);
+        fputc('\t', edgeFile);
+        WriteEdgeFunction(edgeFile, static_cast<UINT32>(edge) - 1);
+        fputc('\n', edgeFile);
+    }
+    fclose(edgeFile);
+}
+
+// Write covered functions (or blocks) to the next numbered dump file and update the lookup file
+// (caller holds client lock and TraceLock)
+static VOID WriteCoverageDump(const std::vector<UINT32>& ids, const std::vector<UINT64>& edges, UINT32 droppedEdges,
+                              const ChildCoverage& children, const std::string& dumpId)
+{
+    DumpCount++;
+
+    // Write current coverage to numbered file (include PID suffix if following children)
+    std::string filename = KnobLogDir.Value() + "/" + ProcessSuffix + std::to_string(DumpCount);
+    std::vector<DumpSection> sections = BuildDumpSections(ids, children);
+    if (KnobBbl.Value()) {
+        WriteBlockDump(filename + ".log", sections);
+    } else {
+        WriteFunctionDump(filename + ".log", sections);
+    }
+    if (KnobEdges.Value()) {
+        WriteEdgeDump(filename + ".edges", edges, droppedEdges);
+    }
+
+    // Update lookup file (include suffix to match log filename), a single append per entry
+    // such that entries of concurrent processes (-follow_child) never interleave
+    if (LookupFd >= 0) {
+        std::string entry = ProcessSuffix + std::to_string(DumpCount) + ";" + dumpId + "\n";
+        if (write(LookupFd, entry.data(), entry.size()) != static_cast<ssize_t>(entry.size()))
+            std::cerr << "Warning: Could not write lookup entry " << DumpCount << std::endl;
+    }
+}
+
+// Collect, write and clear a flag set
+static VOID WriteFlagSet(UINT8** flags, const std::string& dumpId, UINT64 childEntries)
+{
+    PIN_LockClient();
+    {
+        std::lock_guard<std::mutex> guard(TraceLock);
+
+        // Collecting also resets the flag set (and edge table) for later test segments
+        UINT32 droppedEdges;
+        std::vector<UINT64> edges = CollectCurrentTestEdges(flags, &droppedEdges);
+        std::vector<UINT32> ids = CollectCurrentTestFunctions(flags);
+        // A child process that dumps per test (e.g., a GoogleTest executable) writes its own dumps
+        WriteCoverageDump(ids, edges, droppedEdges, CollectChildCoverage(childEntries), dumpId);
+        DumpsItself = true;
+    }
+    PIN_UnlockClient();
+}
+
+// Append call records to the call trace and mark their functions as seen (caller holds TraceLock)
+static VOID WriteCallRecords(const CallRecord* records, UINT64 numRecords)
+{
+    // Threads that exit after Fini flush their buffers when the call trace is closed already
+    if (CallsFile == nullptr)
+        return;
+    fwrite(records, sizeof(CallRecord), numRecords, CallsFile);
+    for (UINT64 i = 0; i < numRecords; i++) {
+        UINT32 id = records[i].fnId;
+        CoveredFlags[id >> FLAG_PAGE_BITS][id & FLAG_PAGE_MASK] = 1;
+    }
+    CallCount += numRecords;
+}
+
+// Internal thread that writes queued dumps (or call trace chunks) in order and returns their buffers
+static VOID DumpWriterThread(VOID* arg)
+{
+    std::unique_lock<std::mutex> guard(QueueLock);
+    for (;;) {
+        if (!DumpQueue.empty()) {
+            DumpJob job = std::move(DumpQueue.front());
+            DumpQueue.pop_front();
+            guard.unlock();
+
+            WriteFlagSet(job.flags, job.dumpId, job.childEntries);
+
+            guard.lock();
+            FreeFlagSets.push_back(job.flags);
+            PIN_SemaphoreSet(&FlagSetFreed);
+            continue;
+        }
+
+        if (!CallQueue.empty()) {
+            CallChunk chunk = CallQueue.front();
+            CallQueue.pop_front();
+            guard.unlock();
+
+            {
+                std::lock_guard<std::mutex> traceGuard(TraceLock);
+                WriteCallRecords(static_cast<const CallRecord*>(chunk.buf), chunk.numRecords);
+            }
+
+            guard.lock();
+            FreeCallBuffers.push_back(chunk.buf);
+            PIN_SemaphoreSet(&CallBufferWritten);
+            continue;
+        }
+
+        // Queues are only drained completely before stopping
+        if (WriterStopping)
+            break;
+        PIN_SemaphoreClear(&JobQueued);
+        guard.unlock();
+        PIN_SemaphoreWait(&JobQueued);
+        guard.lock();
+    }
+}
+
+// Start the writer thread, dumps (and call records) are written synchronously if it cannot be spawned
+static VOID StartDumpWriter()
+{
+    PIN_SemaphoreInit(&JobQueued);
+    PIN_SemaphoreInit(&FlagSetFreed);
+    PIN_SemaphoreInit(&CallBufferWritten);
+    for (UINT32 set = 1; set < NUM_FLAG_SETS; set++) {
+        FreeFlagSets.push_back(FlagSets[set]);
+    }
+    WriterRunning = PIN_SpawnInternalThread(DumpWriterThread, nullptr, 0, &WriterUid) != INVALID_THREADID;
+    if (!WriterRunning) {
+        std::cerr << "Warning: Could not spawn writer thread, writing synchronously" << std::endl;
+    }
+}
+
+// Drain the dump queue and wait for the writer thread to exit
+static VOID StopDumpWriter()
+{
+    if (!WriterRunning)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(QueueLock);
+        WriterStopping = true;
+        PIN_SemaphoreSet(&JobQueued);
+    }
+    PIN_WaitForThreadTermination(WriterUid, PIN_INFINITE_TIMEOUT, nullptr);
+    WriterRunning = false;
+}
+
+static VOID HandleCoverageDump(ADDRINT dumpIdArg)
+{
+    const char* dumpId = reinterpret_cast<const char*>(dumpIdArg);
+
+    // Swap in a free flag set, the test thread only waits if all spare sets are still queued
+    std::unique_lock<std::mutex> guard(QueueLock);
+    if (!WriterRunning || WriterStopping) {
+        guard.unlock();
+        WriteFlagSet(CoveredFlags, dumpId, SharedPublished());
+        return;
+    }
+    while (FreeFlagSets.empty()) {
+        PIN_SemaphoreClear(&FlagSetFreed);
+        guard.unlock();
+        PIN_SemaphoreWait(&FlagSetFreed);
+        guard.lock();
+    }
+    DumpQueue.push_back(DumpJob{CoveredFlags, dumpId, SharedPublished()});
+    ActiveEdges = &EdgeTables[FlagSetIndex(FreeFlagSets.back())];
+    CoveredFlags = FreeFlagSets.back();
+    FreeFlagSets.pop_back();
+    PIN_SemaphoreSet(&JobQueued);
+}
+
+// Called by Pin when the trace buffer of a thread is full (or the thread exits) in -all mode,
+// the full buffer is queued for the writer thread and the thread continues with a spare one
+static VOID* CallBufferFull(BUFFER_ID id, THREADID tid, const CONTEXT* ctxt, VOID* buf,
+                            UINT64 numElements, VOID* v)
+{
+    // Skip if this process doesn't match -trace_only filter
+    if (!ShouldTraceProcess || numElements == 0)
+        return buf;
+
+    std::unique_lock<std::mutex> guard(QueueLock);
+    if (!WriterRunning || WriterStopping) {
+        guard.unlock();
+        std::lock_guard<std::mutex> traceGuard(TraceLock);
+        WriteCallRecords(static_cast<const CallRecord*>(buf), numElements);
+        return buf;
+    }
+    while (CallQueue.size() >= MAX_PENDING_CALL_BUFFERS) {
+        PIN_SemaphoreClear(&CallBufferWritten);
+        guard.unlock();
+        PIN_SemaphoreWait(&CallBufferWritten);
+        guard.lock();
+    }
+    CallQueue.push_back(CallChunk{buf, numElements});
+    VOID* next = nullptr;
+    if (!FreeCallBuffers.empty()) {
+        next = FreeCallBuffers.back();
+        FreeCallBuffers.pop_back();
+    }
+    PIN_SemaphoreSet(&JobQueued);
+    guard.unlock();
+
+    return next != nullptr ? next : PIN_AllocateBuffer(id);
 }
 
 /* ===================================================================== */
 /* Analysis Routines - Called at runtime                                 */
 /* ===================================================================== */
 
-// Called before every function execution
-static VOID FunctionEntry(ADDRINT rtnAddr, const char* rtnName,
-                          const char* imgName, ADDRINT imgLow,
-                          UINT32 rtnSize, const char* srcFile, INT32 srcLine)
+// Called before every function execution in runtime_dump mode (inlined by Pin)
+static VOID PIN_FAST_ANALYSIS_CALL MarkCovered(UINT32 id)
+{
+    CoveredFlags[id >> FLAG_PAGE_BITS][id & FLAG_PAGE_MASK] = 1;
+}
+
+// Called at routine entry in -probe mode, probes cannot be removed, so only the first call per test writes
+static VOID ProbeEntry(UINT32 id)
+{
+    UINT8* flag = &CoveredFlags[id >> FLAG_PAGE_BITS][id & FLAG_PAGE_MASK];
+    if (*flag == 0)
+        *flag = 1;
+}
+
+// Insert an edge into a table without locking, existing edges are only read
+static VOID RecordEdge(EdgeTable* table, UINT32 caller, UINT32 callee)
+{
+    UINT64 key = (static_cast<UINT64>(caller + 1) << 32) | (callee + 1);
+    UINT64 slot = ((key * 0x9E3779B97F4A7C15ULL) >> 20) & table->mask;
+    for (UINT32 probe = 0; probe < MAX_EDGE_PROBES; probe++) {
+        UINT64 current = table->slots[slot];
+        if (current == key)
+            return;
+        if (current == 0) {
+            UINT64 expected = 0;
+            if (__atomic_compare_exchange_n(&table->slots[slot], &expected, key, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED) || expected == key)
+                return;
+        }
+        slot = (slot + 1) & table->mask;
+    }
+    __atomic_fetch_add(&table->dropped, 1, __ATOMIC_RELAXED);
+}
+
+// Called before every function execution in -edges mode
+static VOID EdgeEntry(THREADID tid, UINT32 id, ADDRINT sp)
+{
+    CoveredFlags[id >> FLAG_PAGE_BITS][id & FLAG_PAGE_MASK] = 1;
+
+    ShadowStack* stack = static_cast<ShadowStack*>(PIN_GetThreadData(ShadowStackKey, tid));
+    if (stack == nullptr)
+        return;
+
+    // Frames at or below the current stack pointer have returned (the stack grows downwards)
+    while (stack->depth > 0 && stack->frames[stack->depth - 1].sp <= sp)
+        stack->depth--;
+    UINT32 caller = stack->depth > 0 ? stack->frames[stack->depth - 1].id : NO_CALLER;
+    RecordEdge(ActiveEdges, caller, id);
+
+    if (stack->depth == MAX_SHADOW_DEPTH)
+        stack->depth--;
+    stack->frames[stack->depth].sp = sp;
+    stack->frames[stack->depth].id = id;
+    stack->depth++;
+}
+
+// Write image | symbol | start_addr | end_addr | offset_range | source:line of a resolved function
+// (caller holds TraceLock)
+static VOID WriteFunctionColumns(std::ostream& out, const FunctionInfo& info)
+{
+    const ImageInfo& image = Images[info.imgIndex];
+
+    ADDRINT rtnAddr = info.rtnAddr;
+    ADDRINT rtnEnd = rtnAddr + info.rtnSize;
+    ADDRINT offsetStart = rtnAddr - image.low;
+    ADDRINT offsetEnd = rtnEnd - image.low;
+
+    out << image.name << " | "
+        << info.rtnName << " | "
+        << "0x" << std::hex << rtnAddr << " | "
+        << "0x" << rtnEnd << " | "
+        << "+0x" << offsetStart << "-0x" << offsetEnd << std::dec << " | "
+        << (info.srcFile.empty() ? "??" : info.srcFile) << ":" << info.srcLine;
+}
+
+// Called before every function execution in trace mode (first call of each function only)
+static VOID FunctionEntry(UINT32 id)
 {
     // Skip if this process doesn't match -trace_only filter
     if (!ShouldTraceProcess)
         return;
 
-    std::lock_guard<std::mutex> guard(TraceLock);
-
-    CallCount++;
+    UINT64 callNumber;
+    {
+        std::lock_guard<std::mutex> guard(TraceLock);
 
-    // In runtime_dump mode, track functions for current test segment
-    if (KnobRuntimeDump.Value()) {
-        CurrentTestFunctions.insert(rtnAddr);
-    }
+        callNumber = ++CallCount;
 
-    // If not logging all calls, skip if we've seen this function
-    if (!KnobLogAllCalls.Value()) {
+        // Only the first call of a function is logged (-all 1 records calls through trace buffers)
+        ADDRINT rtnAddr = Functions[id].rtnAddr;
         if (SeenFunctions.count(rtnAddr) > 0) {
             return;
         }
         SeenFunctions.insert(rtnAddr);
     }
 
-    // Skip trace output if in runtime_dump mode (we only want per-test logs)
-    if (KnobRuntimeDump.Value()) {
-        return;
-    }
+    PIN_LockClient();
+    std::unique_lock<std::mutex> guard(TraceLock);
 
-    ADDRINT rtnEnd = rtnAddr + rtnSize;
-    ADDRINT offsetStart = rtnAddr - imgLow;
-    ADDRINT offsetEnd = rtnEnd - imgLow;
+    FunctionInfo& info = Functions[id];
+    ResolveFunction(info);
 
     // Format: call# | image | symbol | start_addr | end_addr | offset_range | source:line
-    TraceFile << CallCount << " | "
-              << BaseName(imgName) << " | "
-              << rtnName << " | "
-              << "0x" << std::hex << rtnAddr << " | "
-              << "0x" << rtnEnd << " | "
-              << "+0x" << offsetStart << "-0x" << offsetEnd << std::dec << " | "
-              << (srcFile[0] ? srcFile : "??") << ":" << srcLine
-              << std::endl;
+    TraceFile << callNumber << " | ";
+    WriteFunctionColumns(TraceFile, info);
+    TraceFile << std::endl;
+
+    guard.unlock();
+    PIN_UnlockClient();
 }
 
 /* ===================================================================== */
 /* Instrumentation Routines - Called at instrumentation time             */
 /* ===================================================================== */
 
-// Called for every routine (function) found in the binary
-static VOID InstrumentRoutine(RTN rtn, VOID* v)
+// Check -libs, -exclude and -filter for an image
+static bool MatchesImageFilters(IMG img)
 {
-    if (!RTN_Valid(rtn))
-        return;
-
-    // Get image information
-    IMG img = IMG_FindByAddress(RTN_Address(rtn));
-    if (!IMG_Valid(img))
-        return;
-
     std::string imgName = IMG_Name(img);
 
     // Filter: main executable only if -libs 0
     if (!KnobIncludeLibs.Value() && !IMG_IsMainExecutable(img))
-        return;
+        return false;
 
     // Filter: exclude images matching -exclude patterns
     if (ShouldExcludeImage(imgName))
-        return;
+        return false;
 
     // Filter: by image name substring if specified
     if (!KnobFilterImage.Value().empty()) {
         if (imgName.find(KnobFilterImage.Value()) == std::string::npos)
-            return;
+            return false;
     }
 
-    // Get routine information
-    std::string rtnName = RTN_Name(rtn);
-    ADDRINT rtnAddr = RTN_Address(rtn);
-    UINT32 rtnSize = RTN_Size(rtn);
-    ADDRINT imgLow = IMG_LowAddress(img);
+    return true;
+}
 
-    // Try to get source location (requires debug info)
-    std::string srcFile;
-    INT32 srcLine = 0;
-    INT32 srcColumn = 0;
+// Check whether an image is instrumented at all
+static bool ShouldInstrumentImage(IMG img)
+{
+    if (!IMG_Valid(img))
+        return false;
 
-    PIN_GetSourceLocation(rtnAddr, &srcColumn, &srcLine, &srcFile);
+    // Routines and traces of an image are instrumented one by one, only check the image once
+    auto cached = InstrumentedImages.find(IMG_Id(img));
+    if (cached != InstrumentedImages.end())
+        return cached->second;
 
-    // In runtime_dump mode, store metadata for later dump
-    if (KnobRuntimeDump.Value()) {
-        FunctionInfo info;
-        info.imgName = BaseName(imgName);
-        info.imgPath = imgName;
-        info.rtnName = rtnName;
-        info.srcFile = srcFile;
-        info.rtnAddr = rtnAddr;
-        info.imgLow = imgLow;
-        info.rtnSize = rtnSize;
-        info.srcLine = srcLine;
-        FunctionMetadata[rtnAddr] = info;
-    }
-
-    // Make copies for the analysis routine (strings need to persist)
-    const char* rtnNameCopy = strdup(rtnName.c_str());
-    const char* imgNameCopy = strdup(imgName.c_str());
-    const char* srcFileCopy = strdup(srcFile.c_str());
-
-    // Insert call to FunctionEntry at routine entry
+    bool instrument = MatchesImageFilters(img);
+    InstrumentedImages.emplace(IMG_Id(img), instrument);
+    return instrument;
+}
+
+// Assign an id to a routine, only the address is kept, the name and source location are resolved lazily
+static bool RegisterRoutine(RTN rtn, IMG img, UINT32* id)
+{
+    FunctionInfo info;
+    info.rtnAddr = RTN_Address(rtn);
+    info.rtnSize = RTN_Size(rtn);
+    info.srcLine = 0;
+    info.resolved = false;
+
+    std::lock_guard<std::mutex> guard(TraceLock);
+    info.imgIndex = GetImageIndex(img);
+    return AddFunction(info, id);
+}
+
+// Called for every routine (function) found in the binary
+static VOID InstrumentRoutine(RTN rtn, VOID* v)
+{
+    if (!RTN_Valid(rtn))
+        return;
+
+    // Get image information
+    IMG img = IMG_FindByAddress(RTN_Address(rtn));
+    if (!ShouldInstrumentImage(img))
+        return;
+
+    UINT32 id;
+    if (!RegisterRoutine(rtn, img, &id))
+        return;
+
+    // Insert call at routine entry
     RTN_Open(rtn);
 
-    RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)FunctionEntry,
-                   IARG_ADDRINT, rtnAddr,
-                   IARG_PTR, rtnNameCopy,
-                   IARG_PTR, imgNameCopy,
-                   IARG_ADDRINT, imgLow,
-                   IARG_UINT32, rtnSize,
-                   IARG_PTR, srcFileCopy,
-                   IARG_UINT32, srcLine,
-                   IARG_END);
+    if (KnobEdges.Value()) {
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)EdgeEntry,
+                       IARG_THREAD_ID,
+                       IARG_UINT32, id,
+                       IARG_REG_VALUE, REG_STACK_PTR,
+                       IARG_END);
+    } else if (KnobRuntimeDump.Value()) {
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)MarkCovered,
+                       IARG_FAST_ANALYSIS_CALL,
+                       IARG_UINT32, id,
+                       IARG_END);
+    } else if (KnobLogAllCalls.Value()) {
+        RTN_InsertFillBuffer(rtn, IPOINT_BEFORE, CallBufferId,
+                             IARG_TSC, offsetof(CallRecord, tsc),
+                             IARG_UINT32, id, offsetof(CallRecord, fnId),
+                             IARG_THREAD_ID, offsetof(CallRecord, tid),
+                             IARG_END);
+    } else {
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)FunctionEntry,
+                       IARG_UINT32, id,
+                       IARG_END);
+    }
 
     RTN_Close(rtn);
 }
 
+// Called for every trace that is compiled (-bbl mode), blocks get the same byte store as routines
+static VOID InstrumentTrace(TRACE trace, VOID* v)
+{
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        BlockInfo info;
+        info.addr = BBL_Address(bbl);
+
+        UINT32 id;
+        {
+            std::lock_guard<std::mutex> guard(TraceLock);
+            auto it = BlockIds.find(info.addr);
+            if (it != BlockIds.end()) {
+                id = it->second;
+            } else {
+                IMG img = IMG_FindByAddress(info.addr);
+                if (!ShouldInstrumentImage(img))
+                    continue;
+                info.imgIndex = GetImageIndex(img);
+                if (!AddBlock(info, &id))
+                    continue;
+            }
+        }
+
+        BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)MarkCovered,
+                       IARG_FAST_ANALYSIS_CALL,
+                       IARG_UINT32, id,
+                       IARG_END);
+    }
+}
+
+// Insert entry probes into all routines of an image (-probe mode), skipping the dump marker
+static VOID InstrumentImageProbed(IMG img, ADDRINT dumpRtnAddr)
+{
+    if (!ShouldInstrumentImage(img))
+        return;
+
+    for (SEC sec = IMG_SecHead(img); SEC_Valid(sec); sec = SEC_Next(sec)) {
+        for (RTN rtn = SEC_RtnHead(sec); RTN_Valid(rtn); rtn = RTN_Next(rtn)) {
+            // Routines that are too short or have branch targets in their prologue cannot be probed
+            if (RTN_Address(rtn) == dumpRtnAddr || !RTN_IsSafeForProbedInsertion(rtn))
+                continue;
+
+            UINT32 id;
+            if (!RegisterRoutine(rtn, img, &id))
+                return;
+            RTN_InsertCallProbed(rtn, IPOINT_BEFORE, (AFUNPTR)ProbeEntry,
+                                 IARG_UINT32, id,
+                                 IARG_END);
+        }
+    }
+}
+
 // Called when a new image (executable or library) is loaded
 static VOID ImageLoad(IMG img, VOID* v)
 {
@@ -397,6 +1405,8 @@ static VOID ImageLoad(IMG img, VOID* v)
 
         // Check if this process should be traced based on -trace_only filter
         ShouldTraceProcess = MatchesTraceOnlyPatterns(MainExeName);
+        // Without the dump marker, the owner only merges child coverage into its dump on exit
+        SetOwnerCollects(ShouldTraceProcess && KnobDumpOnExit.Value());
     }
 
     if (!KnobRuntimeDump.Value()) {
@@ -406,69 +1416,144 @@ static VOID ImageLoad(IMG img, VOID* v)
     }
 
     // In runtime_dump mode, look for our marker function
+    ADDRINT dumpRtnAddr = 0;
     if (KnobRuntimeDump.Value()) {
         RTN rtn = RTN_FindByName(img, "pin_rts_dump_coverage");
         if (RTN_Valid(rtn)) {
-            RTN_Open(rtn);
+            dumpRtnAddr = RTN_Address(rtn);
+            SetOwnerCollects(ShouldTraceProcess);
             // Intercept the call and extract the first argument (dump_id string)
-            RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)HandleCoverageDump,
-                           IARG_FUNCARG_ENTRYPOINT_VALUE, 0,  // First arg = dump_id pointer
-                           IARG_END);
-            RTN_Close(rtn);
+            if (KnobProbe.Value()) {
+                // A marker compiled to a bare ret is too short for a probe, which would silently drop all dumps
+                if (!RTN_IsSafeForProbedInsertion(rtn)) {
+                    std::cerr << "Error: pin_rts_dump_coverage in " << imgName << " is not safe for probes"
+                              << " (e.g., too short), rebuild pin_annotations.c from this version or run without -probe"
+                              << std::endl;
+                    PIN_ExitProcess(1);
+                }
+                RTN_InsertCallProbed(rtn, IPOINT_BEFORE, (AFUNPTR)HandleCoverageDump,
+                                     IARG_FUNCARG_ENTRYPOINT_VALUE, 0,  // First arg = dump_id pointer
+                                     IARG_END);
+            } else {
+                RTN_Open(rtn);
+                RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)HandleCoverageDump,
+                               IARG_FUNCARG_ENTRYPOINT_VALUE, 0,  // First arg = dump_id pointer
+                               IARG_END);
+                RTN_Close(rtn);
+            }
         }
     }
+
+    // Probes have to be inserted at image load, there is no routine instrumentation in probe mode
+    if (KnobProbe.Value())
+        InstrumentImageProbed(img, dumpRtnAddr);
+}
+
+// Called when an image is unloaded, symbols of covered functions can no longer be looked up afterwards
+static VOID ImageUnload(IMG img, VOID* v)
+{
+    // Image ids are not reused, but keep the cache small for programs that load many plugins
+    InstrumentedImages.erase(IMG_Id(img));
+
+    std::lock_guard<std::mutex> guard(TraceLock);
+
+    auto it = ImageIndex.find(IMG_Id(img));
+    if (it == ImageIndex.end())
+        return;
+
+    // Resolve functions of this image that are waiting for the next (or a queued) dump. Calls (-all mode)
+    // may still be pending in the trace buffers of other threads, which cannot be flushed from here, hence
+    // all functions of the image are resolved then.
+    UINT32 numFunctions = static_cast<UINT32>(Functions.size());
+    for (UINT32 id = 0; id < numFunctions; id++) {
+        FunctionInfo& info = Functions[id];
+        if (info.imgIndex != it->second || info.resolved)
+            continue;
+        if (KnobLogAllCalls.Value()) {
+            ResolveFunction(info);
+            continue;
+        }
+        for (UINT32 set = 0; set < NUM_FLAG_SETS; set++) {
+            if (FlagSets[set][id >> FLAG_PAGE_BITS][id & FLAG_PAGE_MASK]) {
+                ResolveFunction(info);
+                break;
+            }
+        }
+    }
+
+    // Another image might be loaded at the same addresses later on
+    for (auto blockIt = BlockIds.begin(); blockIt != BlockIds.end();) {
+        if (Blocks[blockIt->second].imgIndex == it->second)
+            blockIt = BlockIds.erase(blockIt);
+        else
+            ++blockIt;
+    }
+    ImageIndex.erase(it);
 }
 
 // Called when program exits
 static VOID Fini(INT32 code, VOID* v)
 {
     if (KnobRuntimeDump.Value()) {
-        // If dump_on_exit is enabled, dump coverage now using the executable name as test ID
-        // Skip if this process doesn't match -trace_only filter
-        if (KnobDumpOnExit.Value() && !CurrentTestFunctions.empty() && ShouldTraceProcess) {
+        // Probe mode has no prepare-for-fini callback, the writer is still running then
+        StopDumpWriter();
+
+        // Children that publish after this are not collected anymore and write their own dumps
+        SetOwnerCollects(false);
+
+        PIN_LockClient();
+        {
             std::lock_guard<std::mutex> guard(TraceLock);
 
-            DumpCount++;
-
-            // Write coverage to file using main executable name as identifier
-            std::string filename = KnobLogDir.Value() + "/" + ProcessSuffix + std::to_string(DumpCount) + ".log";
-            std::ofstream dumpFile(filename);
-
-            if (dumpFile.is_open()) {
-                // Header line: module_name<tab>module_path
-                dumpFile << MainExeName << "\t" << MainExePath << "\n";
-
-                // Write each function that was called
-                for (ADDRINT addr : CurrentTestFunctions) {
-                    auto it = FunctionMetadata.find(addr);
-                    if (it != FunctionMetadata.end()) {
-                        const FunctionInfo& info = it->second;
-                        ADDRINT offset = info.rtnAddr - info.imgLow;
-                        dumpFile << "\t+0x" << std::hex << offset << std::dec
-                                 << "\t" << (info.srcFile.empty() ? "??" : info.srcFile)
-                                 << "\t" << info.rtnName
-                                 << "\t" << info.srcLine
-                                 << "\n";
-                    }
+            UINT32 droppedEdges;
+            std::vector<UINT64> edges = CollectCurrentTestEdges(CoveredFlags, &droppedEdges);
+            std::vector<UINT32> functions = CollectCurrentTestFunctions(CoveredFlags);
+            // Child processes hand the rest of their coverage to the test running in the owner, unless
+            // they wrote their own dumps or the owner does not collect it
+            if ((DumpsItself || !PublishChildCoverage(functions)) && KnobDumpOnExit.Value() && ShouldTraceProcess) {
+                // If dump_on_exit is enabled, dump coverage now using the executable name as test ID
+                // Skip if this process doesn't match -trace_only filter
+                ChildCoverage children = CollectChildCoverage(SharedPublished());
+                if (!functions.empty() || !children.empty()) {
+                    WriteCoverageDump(functions, edges, droppedEdges, children, MainExeName);
                 }
-                dumpFile.close();
-            }
-
-            // Update lookup file with main executable name as test ID
-            if (LookupFile.is_open()) {
-                LookupFile << ProcessSuffix << DumpCount << ";" << MainExeName << std::endl;
-                LookupFile.flush();
             }
         }
+        PIN_UnlockClient();
+        ReleaseSharedCoverage();
 
         // Close lookup file
-        if (LookupFile.is_open()) {
-            LookupFile.close();
+        if (LookupFd >= 0) {
+            close(LookupFd);
+            LookupFd = -1;
         }
     } else {
+        size_t uniqueFunctions = SeenFunctions.size();
+        if (KnobLogAllCalls.Value()) {
+            StopDumpWriter();
+
+            // Function table for functrace_decode, only functions that occur in the call trace
+            PIN_LockClient();
+            {
+                std::lock_guard<std::mutex> guard(TraceLock);
+                uniqueFunctions = 0;
+                for (UINT32 id : CollectCurrentTestFunctions(CoveredFlags)) {
+                    FunctionInfo& info = Functions[id];
+                    ResolveFunction(info);
+                    TraceFile << "# FUNCTION " << id << " | ";
+                    WriteFunctionColumns(TraceFile, info);
+                    TraceFile << '\n';
+                    uniqueFunctions++;
+                }
+                fclose(CallsFile);
+                CallsFile = nullptr;
+            }
+            PIN_UnlockClient();
+        }
+
         TraceFile << "# ========================================" << std::endl;
         TraceFile << "# Total function calls: " << CallCount << std::endl;
-        TraceFile << "# Unique functions seen: " << SeenFunctions.size() << std::endl;
+        TraceFile << "# Unique functions seen: " << uniqueFunctions << std::endl;
         TraceFile << "# ========================================" << std::endl;
         TraceFile.close();
     }
@@ -478,10 +1563,93 @@ static VOID Fini(INT32 code, VOID* v)
 /* Usage/Help                                                            */
 /* ===================================================================== */
 
+// Called before Pin terminates internal threads (JIT mode), queued dumps are written here
+static VOID PrepareForFini(VOID* v)
+{
+    StopDumpWriter();
+}
+
+// Called when a thread starts (-edges mode), the shadow stack is freed by the TLS destructor
+static VOID ThreadStart(THREADID tid, CONTEXT* ctxt, INT32 flags, VOID* v)
+{
+    ShadowStack* stack = static_cast<ShadowStack*>(malloc(sizeof(ShadowStack)));
+    if (stack == nullptr)
+        return;
+    stack->depth = 0;
+    PIN_SetThreadData(ShadowStackKey, stack, tid);
+}
+
+static VOID FreeShadowStack(VOID* stack)
+{
+    free(stack);
+}
+
 /* ===================================================================== */
 /* Child Process Handling                                                */
 /* ===================================================================== */
 
+// The forking thread holds QueueLock and TraceLock across fork (in this order, as the writer takes them),
+// such that the child never inherits them locked by a thread that does not exist in the child
+static VOID LockBeforeFork()
+{
+    QueueLock.lock();
+    TraceLock.lock();
+}
+
+static VOID UnlockAfterFork()
+{
+    TraceLock.unlock();
+    QueueLock.unlock();
+}
+
+// The writer thread does not survive fork, the child writes (or publishes) its dumps synchronously
+// and leaves queued dumps of the parent to the parent (caller holds QueueLock)
+static VOID ResetDumpWriterInChild()
+{
+    WriterRunning = false;
+    DumpQueue.clear();
+    CallQueue.clear();
+
+    // The shared region is inherited, the child publishes its coverage to the owner
+    SharedOwner = false;
+    DumpsItself = false;
+    if (KnobFollowChild.Value()) {
+        ProcessSuffix = DumpPrefix + "pid" + std::to_string(PIN_GetPid()) + "_";
+    }
+}
+
+static VOID BeforeFork(THREADID tid, const CONTEXT* ctxt, VOID* v)
+{
+    LockBeforeFork();
+}
+
+static VOID AfterForkInParent(THREADID tid, const CONTEXT* ctxt, VOID* v)
+{
+    UnlockAfterFork();
+}
+
+static VOID AfterForkInChild(THREADID tid, const CONTEXT* ctxt, VOID* v)
+{
+    ResetDumpWriterInChild();
+    UnlockAfterFork();
+}
+
+static VOID BeforeForkProbed(UINT32 childPid, VOID* v)
+{
+    LockBeforeFork();
+}
+
+static VOID AfterForkInParentProbed(UINT32 childPid, VOID* v)
+{
+    UnlockAfterFork();
+}
+
+static VOID AfterForkInChildProbed(UINT32 childPid, VOID* v)
+{
+    ResetDumpWriterInChild();
+    UnlockAfterFork();
+}
+
 // Called before a child process is created (fork/exec)
 // Return TRUE to inject Pin into the child, FALSE to let it run natively
 static BOOL FollowChildProcess(CHILD_PROCESS childProcess, VOID* v)
@@ -490,8 +1658,15 @@ static BOOL FollowChildProcess(CHILD_PROCESS childProcess, VOID* v)
         return FALSE;  // Don't follow child processes
     }
 
-    // Get info about the child
-    OS_PROCESS_ID childPid = CHILD_PROCESS_GetId(childProcess);
+    // Exec'd children attach to the shared coverage region of this process (or of its owner)
+    if (Shared != nullptr && !PinCommandLine.empty()) {
+        std::vector<const CHAR*> childArgv;
+        for (const std::string& arg : PinCommandLine)
+            childArgv.push_back(arg.c_str());
+        childArgv.push_back("-shared_coverage");
+        childArgv.push_back(SharedName.c_str());
+        CHILD_PROCESS_SetPinCommandLine(childProcess, static_cast<INT>(childArgv.size()), childArgv.data());
+    }
 
     return TRUE;  // Inject Pin into the child process
 }
@@ -511,6 +1686,12 @@ static INT32 Usage()
     std::cerr << "  -logdir <dir>     Directory for per-test log files" << std::endl;
     std::cerr << "  -follow_child     Follow child processes (fork/exec)" << std::endl;
     std::cerr << "  -dump_on_exit     Dump coverage on process exit (for standalone tests)" << std::endl;
+    std::cerr << "  -bbl              Record basic blocks in DynamoRIO client dump format" << std::endl;
+    std::cerr << "  -text_dump        Write text instead of binary basic block dumps" << std::endl;
+    std::cerr << "  -binary_dump      Write binary function offsets (without symbols)" << std::endl;
+    std::cerr << "  -probe            Record function coverage with probes (near-native speed)" << std::endl;
+    std::cerr << "  -edges            Also record caller-callee edges per test (N.edges files)" << std::endl;
+    std::cerr << "  -edge_budget <mb> Memory budget of the edge tables (default: 64)" << std::endl;
     std::cerr << "  -trace_only <pat> Only trace executables matching patterns (comma-separated)" << std::endl;
     std::cerr << "                    Supports wildcards: test-* matches test-foo, *.sh matches foo.sh" << std::endl;
     std::cerr << std::endl;
@@ -531,6 +1712,31 @@ int main(int argc, char* argv[])
         return Usage();
     }
 
+    // Pin and tool arguments (up to the application), without the region of our own owner
+    for (int i = 0; i < argc && strcmp(argv[i], "--") != 0; i++) {
+        if (strcmp(argv[i], "-shared_coverage") == 0)
+            i++;
+        else
+            PinCommandLine.push_back(argv[i]);
+    }
+
+    if (KnobBbl.Value() && !KnobRuntimeDump.Value()) {
+        std::cerr << "Error: -bbl requires -runtime_dump" << std::endl;
+        return 1;
+    }
+
+    if (KnobProbe.Value() && (!KnobRuntimeDump.Value() || KnobBbl.Value())) {
+        std::cerr << "Error: -probe requires -runtime_dump and cannot be combined with -bbl" << std::endl;
+        return 1;
+    }
+
+    if (KnobEdges.Value() && (!KnobRuntimeDump.Value() || KnobBbl.Value() || KnobProbe.Value())) {
+        std::cerr << "Error: -edges requires -runtime_dump and cannot be combined with -bbl or -probe" << std::endl;
+        return 1;
+    }
+
+    InitImageFilters();
+
     // Runtime dump mode setup
     if (KnobRuntimeDump.Value()) {
         // Create log directory
@@ -540,23 +1746,41 @@ int main(int argc, char* argv[])
             return 1;
         }
 
-        // Set process suffix for unique filenames when following children
+        // Set process suffix for unique filenames of shards and when following children
+        DumpPrefix = GetDumpPrefix();
         if (KnobFollowChild.Value()) {
-            ProcessSuffix = "pid" + std::to_string(PIN_GetPid()) + "_";
+            ProcessSuffix = DumpPrefix + "pid" + std::to_string(PIN_GetPid()) + "_";
         } else {
-            ProcessSuffix = "";
+            ProcessSuffix = DumpPrefix;
+        }
+
+        // Share coverage with child processes, otherwise children write their own dumps
+        if (KnobFollowChild.Value() && !InitSharedCoverage()) {
+            std::cerr << "Warning: Could not map shared coverage region, child processes write their own dumps"
+                      << std::endl;
         }
 
-        // Open lookup file (append mode when following children to collect all entries)
+        // Open lookup file (appended to by all processes when following children)
         std::string lookupPath = KnobLogDir.Value() + "/dump-lookup.log";
-        std::ios_base::openmode mode = KnobFollowChild.Value() ?
-            (std::ios::out | std::ios::app) : std::ios::out;
-        LookupFile.open(lookupPath, mode);
-        if (!LookupFile.is_open()) {
+        int flags = O_WRONLY | O_CREAT | O_APPEND | (KnobFollowChild.Value() ? 0 : O_TRUNC);
+        LookupFd = open(lookupPath.c_str(), flags, 0644);
+        if (LookupFd < 0) {
             std::cerr << "Error: Could not open lookup file "
                       << lookupPath << std::endl;
             return 1;
         }
+
+        // Edge tables and shadow call stacks
+        if (KnobEdges.Value()) {
+            ShadowStackKey = PIN_CreateThreadDataKey(FreeShadowStack);
+            if (ShadowStackKey == INVALID_TLS_KEY || !InitEdgeTables()) {
+                std::cerr << "Error: Could not allocate edge tables" << std::endl;
+                return 1;
+            }
+            PIN_AddThreadStartFunction(ThreadStart, 0);
+        }
+
+        StartDumpWriter();
     } else {
         // Standard mode - open output file
         TraceFile.open(KnobOutputFile.Value().c_str());
@@ -568,22 +1792,65 @@ int main(int argc, char* argv[])
 
         // Write header
         TraceFile << "# Function Trace Output" << std::endl;
-        TraceFile << "# Format: call# | image | symbol | start_addr | end_addr | offset_range | source:line" << std::endl;
+        if (KnobLogAllCalls.Value()) {
+            // Calls are recorded as binary records, the function table is written in Fini
+            std::string callsPath = KnobOutputFile.Value() + ".calls";
+            CallsFile = fopen(callsPath.c_str(), "wb");
+            if (CallsFile == nullptr) {
+                std::cerr << "Error: Could not open call trace file " << callsPath << std::endl;
+                return 1;
+            }
+            CallTraceHeader header = {CALL_TRACE_MAGIC, CALL_TRACE_VERSION};
+            fwrite(&header, sizeof(header), 1, CallsFile);
+
+            CallBufferId = PIN_DefineTraceBuffer(sizeof(CallRecord), CALL_BUFFER_PAGES, CallBufferFull, 0);
+            if (CallBufferId == BUFFER_ID_INVALID) {
+                std::cerr << "Error: Could not define call trace buffer" << std::endl;
+                return 1;
+            }
+            StartDumpWriter();
+
+            TraceFile << "# Calls: " << callsPath << " (decode with functrace_decode)" << std::endl;
+            TraceFile << "# Format: # FUNCTION id | image | symbol | start_addr | end_addr | offset_range | source:line" << std::endl;
+        } else {
+            TraceFile << "# Format: call# | image | symbol | start_addr | end_addr | offset_range | source:line" << std::endl;
+        }
         TraceFile << "# ========================================" << std::endl;
     }
 
     // Register callbacks
     IMG_AddInstrumentFunction(ImageLoad, 0);
-    RTN_AddInstrumentFunction(InstrumentRoutine, 0);
+    IMG_AddUnloadFunction(ImageUnload, 0);
+    if (KnobBbl.Value()) {
+        TRACE_AddInstrumentFunction(InstrumentTrace, 0);
+    } else if (!KnobProbe.Value()) {
+        RTN_AddInstrumentFunction(InstrumentRoutine, 0);
+    }
     PIN_AddFiniFunction(Fini, 0);
+    if (KnobRuntimeDump.Value() || KnobLogAllCalls.Value()) {
+        if (KnobProbe.Value()) {
+            PIN_AddForkFunctionProbed(FPOINT_BEFORE, BeforeForkProbed, 0);
+            PIN_AddForkFunctionProbed(FPOINT_AFTER_IN_PARENT, AfterForkInParentProbed, 0);
+            PIN_AddForkFunctionProbed(FPOINT_AFTER_IN_CHILD, AfterForkInChildProbed, 0);
+        } else {
+            PIN_AddPrepareForFiniFunction(PrepareForFini, 0);
+            PIN_AddForkFunction(FPOINT_BEFORE, BeforeFork, 0);
+            PIN_AddForkFunction(FPOINT_AFTER_IN_PARENT, AfterForkInParent, 0);
+            PIN_AddForkFunction(FPOINT_AFTER_IN_CHILD, AfterForkInChild, 0);
+        }
+    }
 
     // Register child process callback if enabled
     if (KnobFollowChild.Value()) {
         PIN_AddFollowChildProcessFunction(FollowChildProcess, 0);
     }
 
-    // Start the program
-    PIN_StartProgram();
+    // Start the program (never returns)
+    if (KnobProbe.Value()) {
+        PIN_StartProgramProbed();
+    } else {
+        PIN_StartProgram();
+    }
 
     return 0;
 }
@@ -0,0 +1,34 @@
+/*
+ * functrace_calls.h - Binary call trace format of functrace (-all mode)
+ *
+ * With -all 1, functrace records every call as a fixed-size record through
+ * Pin's trace buffers and writes the records to <output>.calls:
+ *
+ *   CallTraceHeader | CallRecord | CallRecord | ...
+ *
+ * Records of a thread are in call order, records of different threads are
+ * interleaved in buffer-sized chunks. Function ids refer to the function table
+ * that is written to the text output file (<output>). Both files are turned
+ * into a readable trace by functrace_decode.
+ */
+
+#ifndef FUNCTRACE_CALLS_H
+#define FUNCTRACE_CALLS_H
+
+#include <stdint.h>
+
+#define CALL_TRACE_MAGIC 0x43525446 /* "FTRC" */
+#define CALL_TRACE_VERSION 1
+
+struct CallTraceHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct CallRecord {
+    uint64_t tsc;   /* Time stamp counter at function entry */
+    uint32_t fnId;  /* Dense function id, see the function table */
+    uint32_t tid;   /* Pin thread id */
+};
+
+#endif /* FUNCTRACE_CALLS_H */
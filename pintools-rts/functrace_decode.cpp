@@ -0,0 +1,94 @@
+/*
+ * functrace_decode.cpp - Decode the binary call trace of functrace (-all mode)
+ *
+ * Reads the function table from the text output of functrace and prints every
+ * record of the binary call trace in the text trace format, extended by the
+ * thread id and time stamp counter:
+ *
+ *   call# | tid | tsc | image | symbol | start_addr | end_addr | offset_range | source:line
+ *
+ * Usage:
+ *   functrace_decode functrace.out functrace.out.calls > calls.txt
+ */
+
+#include "functrace_calls.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Function table lines: # FUNCTION <id> | image | symbol | start_addr | end_addr | offset_range | source:line
+static const std::string FunctionPrefix = "# FUNCTION ";
+
+static bool ReadFunctionTable(const std::string& path, std::vector<std::string>& functions)
+{
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        std::cerr << "Error: Could not open " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.compare(0, FunctionPrefix.size(), FunctionPrefix) != 0)
+            continue;
+        size_t separator = line.find(" | ", FunctionPrefix.size());
+        if (separator == std::string::npos)
+            continue;
+        size_t id = std::stoul(line.substr(FunctionPrefix.size(), separator - FunctionPrefix.size()));
+        if (id >= functions.size())
+            functions.resize(id + 1);
+        functions[id] = line.substr(separator + 3);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <functrace.out> <functrace.out.calls>" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> functions;
+    if (!ReadFunctionTable(argv[1], functions))
+        return 1;
+
+    FILE* calls = fopen(argv[2], "rb");
+    if (calls == nullptr) {
+        std::cerr << "Error: Could not open " << argv[2] << std::endl;
+        return 1;
+    }
+
+    CallTraceHeader header;
+    if (fread(&header, sizeof(header), 1, calls) != 1 || header.magic != CALL_TRACE_MAGIC) {
+        std::cerr << "Error: " << argv[2] << " is not a functrace call trace" << std::endl;
+        fclose(calls);
+        return 1;
+    }
+    if (header.version != CALL_TRACE_VERSION) {
+        std::cerr << "Error: Unsupported call trace version " << header.version << std::endl;
+        fclose(calls);
+        return 1;
+    }
+
+    const std::string unknown = "?? | ?? | ?? | ?? | ?? | ??:0";
+    CallRecord records[4096];
+    uint64_t callNumber = 0;
+    size_t count;
+    while ((count = fread(records, sizeof(CallRecord), sizeof(records) / sizeof(records[0]), calls)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const CallRecord& record = records[i];
+            const std::string& function = record.fnId < functions.size() && !functions[record.fnId].empty()
+                                              ? functions[record.fnId] : unknown;
+            printf("%llu | %u | %llu | %s\n",
+                   static_cast<unsigned long long>(++callNumber),
+                   record.tid,
+                   static_cast<unsigned long long>(record.tsc),
+                   function.c_str());
+        }
+    }
+    fclose(calls);
+    return 0;
+}
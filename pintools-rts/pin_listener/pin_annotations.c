@@ -8,6 +8,9 @@
 
 #include "pin_annotations.h"
 
+/* Bytes of padding in the marker, more than the largest probe Pin inserts on IA-32 and Intel 64 */
+#define PIN_RTS_PROBE_PADDING "16"
+
 /*
  * Marker function for coverage dumps.
  *
@@ -17,11 +20,13 @@
  * The used attribute prevents the linker from removing it as unused.
  *
  * The asm volatile prevents the compiler from optimizing away the
- * function body entirely.
+ * function body entirely. Its padding makes the body long enough for
+ * a probe (-probe), which replaces the first instructions of the
+ * function with a jump; an empty body compiles to a single ret at -O2.
  */
 __attribute__((noinline, used))
 void pin_rts_dump_coverage(const char* dump_id)
 {
-    /* Prevent compiler from optimizing this away */
-    __asm__ volatile("" : : "r"(dump_id) : "memory");
+    /* Prevent compiler from optimizing this away, and pad for probes */
+    __asm__ volatile(".rept " PIN_RTS_PROBE_PADDING "\n\tnop\n\t.endr" : : "r"(dump_id) : "memory");
 }
@@ -24,6 +24,10 @@ extern "C" {
  * 1. Writes accumulated function coverage to a numbered log file
  * 2. Records the mapping from dump number to dump_id in lookup file
  * 3. Resets coverage tracking for the next test segment
+ *
+ * With -probe, the tool inserts a probe at the entry of this function,
+ * hence its body must be at least as long as a probe (see
+ * pin_annotations.c); the tool exits with an error otherwise.
  */
 void pin_rts_dump_coverage(const char* dump_id);
 
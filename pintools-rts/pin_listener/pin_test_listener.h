@@ -8,6 +8,7 @@
 #ifndef PIN_TEST_LISTENER_H
 #define PIN_TEST_LISTENER_H
 
+#include <cstddef>
 #include <string>
 
 class PinTestListener {
@@ -23,7 +24,9 @@ public:
     /* Called when an individual test begins */
     static void TestStart(const std::string& testIdentifier);
 
-    /* Called when an individual test ends. Result is "PASSED" or "FAILED" */
+    /* Called when an individual test ends. Result is "PASSED" or "FAILED".
+       If BINARY_RTS_LOGDIR is set, the test's wall time, CPU time and peak RSS are appended to
+       test-resources.csv in that directory */
     static void TestEnd(const std::string& result);
 
     /* Called when a test suite ends. Result is "PASSED" or "FAILED" */
@@ -51,6 +54,19 @@ std::string ParseExcludesFileToGoogleTestFilter(
     const std::string& path,
     const std::string& previousFilter = std::string());
 
+/*
+ * Load the excluded tests of the current executable from an excludes file into a hash set.
+ * Checking IsTestExcluded in OnTestStart (and skipping with GTEST_SKIP) avoids a GoogleTest
+ * filter with one pattern per excluded test. Returns the number of excluded tests (and suites).
+ */
+size_t LoadTestExcludesFile(const std::string& path);
+
+/*
+ * Check if a test (or its whole suite) was excluded by LoadTestExcludesFile. Excluded tests are
+ * skipped before TestStart and without TestEnd, such that they write no dump.
+ */
+bool IsTestExcluded(const std::string& testSuiteIdentifier, const std::string& testIdentifier);
+
 /*
  * Get the excludes file path from environment variable GTEST_EXCLUDES_FILE.
  */
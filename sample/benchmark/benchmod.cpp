@@ -0,0 +1,72 @@
+#include "benchmod.h"
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#ifndef BENCH_MODULE_ID
+#error "BENCH_MODULE_ID must be defined"
+#endif
+#ifndef BENCH_FUNCTIONS
+#define BENCH_FUNCTIONS 256
+#endif
+
+BENCH_DECLARE_MODULE(BENCH_MODULE_ID)
+
+namespace {
+    using StepFunction = int (*)(int);
+
+    // Each instantiation is a distinct function with a handful of BBs.
+    template<std::size_t N>
+    BENCH_NOINLINE int step(int x) {
+        const int n = static_cast<int>(N) + BENCH_MODULE_ID;
+        switch ((x ^ n) & 7) {
+            case 0:
+                return x + n;
+            case 1:
+                return x * 3 - n;
+            case 2:
+                return (x >> 1) ^ n;
+            case 3:
+                return x - (n << 2);
+            case 4:
+                return x * n + 1;
+            case 5:
+                return (x << 3) + n;
+            case 6:
+                return x ^ (n * 7);
+            default:
+                return x + 1;
+        }
+    }
+
+    template<std::size_t... I>
+    std::array<StepFunction, sizeof...(I)> makeSteps(std::index_sequence<I...>) {
+        return {{&step<I>...}};
+    }
+
+    const std::array<StepFunction, BENCH_FUNCTIONS> steps = makeSteps(std::make_index_sequence<BENCH_FUNCTIONS>());
+}
+
+int BENCH_SYMBOL(BENCH_MODULE_ID, call)(int seed, int rounds) {
+    int x = seed;
+    for (int round = 0; round < rounds; round++) {
+        for (StepFunction function: steps) {
+            x = function(x);
+        }
+    }
+    return x;
+}
+
+int BENCH_SYMBOL(BENCH_MODULE_ID, loop)(int seed, int iterations) {
+    unsigned int x = static_cast<unsigned int>(seed);
+    for (int i = 0; i < iterations; i++) {
+        x = x * 1103515245u + 12345u;
+        if (x & 1u) {
+            x ^= x >> 7;
+        } else {
+            x += BENCH_MODULE_ID;
+        }
+    }
+    return static_cast<int>(x);
+}
@@ -0,0 +1,35 @@
+#ifndef BINARYRTS_BENCHMOD_H
+#define BINARYRTS_BENCHMOD_H
+
+// Synthetic benchmark modules: every module is a shared library built from benchmod.cpp, and exports its
+// entry points with the module id in their names (e.g., `benchmod_3_call`).
+
+#ifdef _WIN32
+    #ifdef BENCH_BUILD_MODULE
+        #define BENCH_API __declspec(dllexport)
+    #else
+        #define BENCH_API __declspec(dllimport)
+    #endif
+    #define BENCH_NOINLINE __declspec(noinline)
+#else
+    #define BENCH_API __attribute__((visibility("default")))
+    #define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+#define BENCH_SYMBOL_(id, name) benchmod_##id##_##name
+#define BENCH_SYMBOL(id, name) BENCH_SYMBOL_(id, name)
+
+// Call-heavy entry: calls each of the module's functions `rounds` times.
+// Loop-heavy entry: runs a single hot loop with few BBs for `iterations` iterations.
+#define BENCH_DECLARE_MODULE(id) \
+    extern "C" BENCH_API int BENCH_SYMBOL(id, call)(int seed, int rounds); \
+    extern "C" BENCH_API int BENCH_SYMBOL(id, loop)(int seed, int iterations);
+
+#define BENCH_MODULE_ENTRY(id) {BENCH_SYMBOL(id, call), BENCH_SYMBOL(id, loop)}
+
+struct BenchModule {
+    int (*call)(int seed, int rounds);
+    int (*loop)(int seed, int iterations);
+};
+
+#endif //BINARYRTS_BENCHMOD_H
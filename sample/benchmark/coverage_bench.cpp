@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "benchmod_registry.h"
+
+#ifndef BENCH_CALL_ROUNDS
+#define BENCH_CALL_ROUNDS 100
+#endif
+#ifndef BENCH_LOOP_ITERATIONS
+#define BENCH_LOOP_ITERATIONS 1000000
+#endif
+#ifndef BENCH_THREADS
+#define BENCH_THREADS 8
+#endif
+
+namespace {
+    constexpr int numModules = sizeof(benchModules) / sizeof(benchModules[0]);
+
+    // Keeps the compiler from dropping the workloads.
+    volatile int sink;
+}
+
+class ModuleBench : public ::testing::TestWithParam<int> {
+};
+
+// Many distinct functions and BBs, each executed a few times.
+TEST_P(ModuleBench, CallHeavy) {
+    sink = benchModules[GetParam()].call(GetParam(), BENCH_CALL_ROUNDS);
+}
+
+// Few BBs, executed very often.
+TEST_P(ModuleBench, LoopHeavy) {
+    sink = benchModules[GetParam()].loop(GetParam(), BENCH_LOOP_ITERATIONS);
+}
+
+INSTANTIATE_TEST_SUITE_P(Modules, ModuleBench, ::testing::Range(0, numModules));
+
+// All modules, called concurrently from several threads.
+TEST(ThreadBench, Multithreaded) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        threads.emplace_back([t]() {
+            int x = t;
+            for (int module = t % numModules; module < numModules; module += 1) {
+                x = benchModules[module].call(x, BENCH_CALL_ROUNDS / BENCH_THREADS + 1);
+                x = benchModules[module].loop(x, BENCH_LOOP_ITERATIONS / BENCH_THREADS + 1);
+            }
+            sink = x;
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
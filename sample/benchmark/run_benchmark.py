@@ -0,0 +1,212 @@
+"""
+This script runs the coverage benchmark (`coverage_bench`) natively, with the BinaryRTS DynamoRIO client (without
+runtime dumps, and with runtime dumps for each trace policy) and with the Pin tool, and writes the runtimes, per-dump
+latencies, log sizes and probe counters as JSON.
+If a baseline JSON file of a previous run is given, the script fails if the overhead, dump latency or log size of a
+configuration regressed by more than the given ratio.
+"""
+import argparse
+import json
+import os
+import platform
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+from typing import Dict, List, Optional
+
+DUMP_LOOKUP_FILE: str = "dump-lookup.log"
+STATS_FILE: str = "coverage.stats.json"
+# Client counters that show the effect of -trace_policy.
+TRACE_COUNTERS: List[str] = ["probes_inserted", "trace_probes_skipped", "trace_flushes"]
+
+
+def parse_arguments() -> argparse.Namespace:
+    """
+    Define and parse program arguments.
+
+    :return: arguments captured in object.
+    """
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--exe", required=True, help="Benchmark executable with the DynamoRIO listener.")
+    parser.add_argument("--pin-exe", help="Benchmark executable with the Pin listener.")
+    parser.add_argument("--dynamorio", help="DynamoRIO root directory (containing bin64/drrun).")
+    parser.add_argument("--client", help="BinaryRTS DynamoRIO client library.")
+    parser.add_argument("--pin", help="Pin kit root directory (containing pin).")
+    parser.add_argument("--pintool", help="BinaryRTS Pin tool (functrace.so).")
+    parser.add_argument("--repetitions", "-r", type=int, default=3, help="Runs per configuration.")
+    parser.add_argument("--gtest-filter", help="Only run the benchmark tests matching this GoogleTest filter.")
+    parser.add_argument("--output", "-o", help="Output JSON file (default: stdout).")
+    parser.add_argument("--baseline", help="JSON output of a previous run to compare against.")
+    parser.add_argument(
+        "--max-regression",
+        type=float,
+        default=0.25,
+        help="Maximum relative regression against the baseline (default: 0.25).",
+    )
+    return parser.parse_args()
+
+
+def get_configurations(args: argparse.Namespace) -> Dict[str, List[str]]:
+    """
+    Command prefixes of all configurations that can be run with the given arguments.
+    """
+    # Runs are started in their log directory, hence all paths must be absolute.
+    for arg in ["exe", "pin_exe", "client", "pintool"]:
+        if getattr(args, arg):
+            setattr(args, arg, str(Path(getattr(args, arg)).resolve()))
+    configurations: Dict[str, List[str]] = {"native": [args.exe]}
+    if args.dynamorio and args.client:
+        drrun: Path = Path(args.dynamorio) / "bin64" / ("drrun.exe" if platform.system() == "Windows" else "drrun")
+        client: List[str] = [str(drrun), "-c", args.client, "-logdir", "{logdir}", "-stats"]
+        configurations["dr_analysis"] = client + ["--", args.exe]
+        configurations["dr_runtime_dump"] = client + ["-runtime_dump", "--", args.exe]
+        for policy in ["skip_recorded", "head"]:
+            configurations[f"dr_runtime_dump_{policy}"] = client + [
+                "-runtime_dump", "-trace_policy", policy, "--", args.exe
+            ]
+    if args.pin and args.pintool and args.pin_exe:
+        pin: Path = Path(args.pin) / ("pin.exe" if platform.system() == "Windows" else "pin")
+        configurations["pin_runtime_dump"] = [
+            str(pin), "-t", args.pintool, "-runtime_dump", "-logdir", "{logdir}", "--", args.pin_exe
+        ]
+    return configurations
+
+
+def summarize(values: List[float]) -> Optional[Dict[str, float]]:
+    if len(values) == 0:
+        return None
+    values = sorted(values)
+    return {
+        "mean": statistics.mean(values),
+        "p50": values[len(values) // 2],
+        "p95": values[min(len(values) - 1, int(len(values) * 0.95))],
+        "max": values[-1],
+    }
+
+
+def collect_logs(logdir: Path) -> Dict:
+    """
+    Collects the number of dumps, the size of all dumps, and (with client stats) the per-dump latencies.
+    """
+    lookup_file: Path = logdir / DUMP_LOOKUP_FILE
+    dumps: int = len(lookup_file.read_text().splitlines()) if lookup_file.exists() else 0
+    log_bytes: int = sum(
+        file.stat().st_size
+        for file in logdir.rglob("*")
+        if file.is_file() and ".log" in file.name and file.name != DUMP_LOOKUP_FILE
+    )
+    dump_us: List[float] = []
+    dump_bbs: Dict[str, int] = {}
+    counters: Dict[str, int] = {}
+    # Stats files are prefixed with the dump prefix, e.g., of GoogleTest shards.
+    for stats_file in logdir.rglob(f"*{STATS_FILE}"):
+        try:
+            stats = json.loads(stats_file.read_text())
+            dump_us.extend(float(dump["us"]) for dump in stats.get("dumps", []))
+            dump_bbs.update({dump["id"]: int(dump["bbs"]) for dump in stats.get("dumps", [])})
+            for counter in TRACE_COUNTERS:
+                counters[counter] = counters.get(counter, 0) + int(stats.get("counters", {}).get(counter, 0))
+        except (ValueError, KeyError) as e:
+            print(f"Failed to parse {stats_file}: {e}", file=sys.stderr)
+    return {"dumps": dumps, "log_bytes": log_bytes, "dump_us": dump_us, "dump_bbs": dump_bbs, "counters": counters}
+
+
+def run_configuration(name: str, command: List[str], args: argparse.Namespace) -> Dict:
+    wall_s: List[float] = []
+    dump_us: List[float] = []
+    dumps: int = 0
+    log_bytes: int = 0
+    counters: Dict[str, int] = {}
+    dump_bbs: Dict[str, int] = {}
+    for repetition in range(args.repetitions):
+        logdir: Path = Path(tempfile.mkdtemp(prefix=f"binaryrts-bench-{name}-"))
+        try:
+            cmd: List[str] = [part.replace("{logdir}", str(logdir)) for part in command]
+            if args.gtest_filter:
+                cmd.append(f"--gtest_filter={args.gtest_filter}")
+            env: Dict[str, str] = dict(os.environ, BINARY_RTS_LOGDIR=str(logdir))
+            start: float = time.perf_counter()
+            process = subprocess.run(cmd, cwd=logdir, env=env, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+            wall_s.append(time.perf_counter() - start)
+            if process.returncode != 0:
+                print(process.stderr.decode(errors="replace"), file=sys.stderr)
+                raise RuntimeError(f"{name} failed with exit code {process.returncode}: {' '.join(cmd)}")
+            logs: Dict = collect_logs(logdir)
+            # Dumps and log sizes are deterministic, only latencies of all repetitions are kept.
+            dumps, log_bytes, counters, dump_bbs = logs["dumps"], logs["log_bytes"], logs["counters"], logs["dump_bbs"]
+            dump_us.extend(logs["dump_us"])
+        finally:
+            shutil.rmtree(logdir, ignore_errors=True)
+    return {
+        "command": command,
+        "wall_s": wall_s,
+        "wall_s_median": statistics.median(wall_s),
+        "dumps": dumps,
+        "log_bytes": log_bytes,
+        "dump_us": summarize(dump_us),
+        "counters": counters,
+        "dump_bbs": dump_bbs,
+    }
+
+
+def find_regressions(results: Dict, baseline: Dict, max_regression: float) -> List[str]:
+    regressions: List[str] = []
+    for name, result in results["configurations"].items():
+        if name not in baseline.get("configurations", {}):
+            continue
+        base: Dict = baseline["configurations"][name]
+        metrics = [
+            ("overhead", result.get("overhead"), base.get("overhead")),
+            ("log_bytes", result["log_bytes"], base.get("log_bytes")),
+            ("dump_us.mean", (result["dump_us"] or {}).get("mean"), (base.get("dump_us") or {}).get("mean")),
+        ]
+        for metric, value, base_value in metrics:
+            if value is not None and base_value and value > base_value * (1 + max_regression):
+                regressions.append(f"{name} {metric}: {value:.3f} (baseline: {base_value:.3f})")
+    return regressions
+
+
+def main():
+    # Parse arguments
+    args = parse_arguments()
+
+    results: Dict = {"platform": platform.platform(), "repetitions": args.repetitions, "configurations": {}}
+    for name, command in get_configurations(args).items():
+        print(f"Running {name}...", file=sys.stderr)
+        results["configurations"][name] = run_configuration(name, command, args)
+
+    # Overhead relative to the native run.
+    native_s: float = results["configurations"]["native"]["wall_s_median"]
+    for result in results["configurations"].values():
+        result["overhead"] = result["wall_s_median"] / native_s if native_s > 0 else None
+
+    # Trace policies must not lose coverage, i.e., every test has to dump as many BBs as with the default policy.
+    reference: Dict[str, int] = results["configurations"].get("dr_runtime_dump", {}).get("dump_bbs", {})
+    for name, result in results["configurations"].items():
+        if name.startswith("dr_runtime_dump_") and len(reference) > 0:
+            result["dumps_missing_bbs"] = sorted(
+                dump_id for dump_id, bbs in reference.items() if result["dump_bbs"].get(dump_id, 0) < bbs
+            )
+
+    output: str = json.dumps(results, indent=2)
+    if args.output:
+        Path(args.output).write_text(output)
+    else:
+        print(output)
+
+    if args.baseline:
+        regressions: List[str] = find_regressions(
+            results, json.loads(Path(args.baseline).read_text()), args.max_regression
+        )
+        for regression in regressions:
+            print(f"Regression: {regression}", file=sys.stderr)
+        if len(regressions) > 0:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -18,11 +18,22 @@ public:
     }
 
     void OnTestStart(const testing::TestInfo& testInfo) override {
+#ifdef TEST_SELECTION
+        // Excluded tests do not dump, such that their coverage of earlier runs is kept
+        if (IsTestExcluded(testInfo.test_suite_name(), testInfo.name())) {
+            GTEST_SKIP() << "Excluded by test selection";
+        }
+#endif
         PinTestListener::TestStart(testInfo.name());
     }
 
     void OnTestEnd(const testing::TestInfo& test_info) override {
-        PinTestListener::TestEnd(test_info.result()->Passed() ? "PASSED": "FAILED");
+#ifdef TEST_SELECTION
+        if (IsTestExcluded(test_info.test_suite_name(), test_info.name())) {
+            return;
+        }
+#endif
+        PinTestListener::TestEnd(test_info.result()->Skipped() ? "SKIPPED" : test_info.result()->Passed() ? "PASSED": "FAILED");
     }
 
     void OnTestSuiteEnd(const testing::TestSuite& testSuite) override {
@@ -59,11 +70,22 @@ public:
     }
 
     void OnTestStart(const testing::TestInfo& testInfo) override {
+#ifdef TEST_SELECTION
+        // Excluded tests do not dump, such that their coverage of earlier runs is kept
+        if (IsTestExcluded(testInfo.test_suite_name(), testInfo.name())) {
+            GTEST_SKIP() << "Excluded by test selection";
+        }
+#endif
         BinaryRTSTestListener::TestStart(testInfo.name());
     }
 
     void OnTestEnd(const testing::TestInfo& test_info) override {
-        BinaryRTSTestListener::TestEnd(test_info.result()->Passed() ? "PASSED": "FAILED");
+#ifdef TEST_SELECTION
+        if (IsTestExcluded(test_info.test_suite_name(), test_info.name())) {
+            return;
+        }
+#endif
+        BinaryRTSTestListener::TestEnd(test_info.result()->Skipped() ? "SKIPPED" : test_info.result()->Passed() ? "PASSED": "FAILED");
     }
 
     void OnTestSuiteEnd(const testing::TestSuite& testSuite) override {
@@ -108,10 +130,9 @@ int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     ::testing::AddGlobalTestEnvironment(new CustomEnvironment);
 #ifdef TEST_SELECTION
+    // Excluded tests are skipped in CoverageEventListener::OnTestStart.
     if (const char* excludes_file = GetTestExcludesFileFromEnv()) {
-        std::string previousFilter = ::testing::GTEST_FLAG(filter);
-        std::cout << "BEFORE: " << previousFilter << "\n";
-        ::testing::GTEST_FLAG(filter) = ParseExcludesFileToGoogleTestFilter(excludes_file, previousFilter);
+        LoadTestExcludesFile(excludes_file);
     }
 #endif
 #if defined(TEST_LISTENER) || defined(PIN_LISTENER)
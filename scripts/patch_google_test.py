@@ -26,11 +26,19 @@ public:
     }
 
     void OnTestStart(const testing::TestInfo& testInfo) override {
+        // Skips tests excluded by LoadTestExcludesFile (if any), which do not dump, such that their coverage of
+        // earlier runs is kept.
+        if (IsTestExcluded(testInfo.test_suite_name(), testInfo.name())) {
+            GTEST_SKIP() << "Excluded by BinaryRTS";
+        }
         BinaryRTSTestListener::TestStart(testInfo.name());
     }
 
     void OnTestEnd(const testing::TestInfo& test_info) override {
-        BinaryRTSTestListener::TestEnd(test_info.result()->Passed() ? "PASSED": "FAILED");
+        if (IsTestExcluded(test_info.test_suite_name(), test_info.name())) {
+            return;
+        }
+        BinaryRTSTestListener::TestEnd(test_info.result()->Skipped() ? "SKIPPED" : test_info.result()->Passed() ? "PASSED": "FAILED");
     }
 
     void OnTestSuiteEnd(const testing::TestSuite& testSuite) override {
@@ -52,10 +60,10 @@ LISTENER_CODE: str = """
 """
 SELECTOR_CODE: str = r"""
 // Start generated code by BinaryRTS.
-// Allows excluding tests from a file.
+// Allows excluding tests from a file, excluded tests are skipped by the listener.
 if (const char* excludes_file = GetTestExcludesFileFromEnv()) {
-    std::string previousFilter = ::testing::GTEST_FLAG(filter);
-    ::testing::GTEST_FLAG(filter) = ParseExcludesFileToGoogleTestFilter(excludes_file, previousFilter);
+    LoadTestExcludesFile(excludes_file);
+    ::testing::UnitTest::GetInstance()->listeners().Append(new CoverageEventListener());
 }
 // End generated code.
 """